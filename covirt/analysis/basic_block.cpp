@@ -3,20 +3,305 @@
 
 #include <utils/log.hpp>
 
+#include <optional>
 #include <queue>
 #include <set>
 
-covirt::subroutine covirt::decompose_bb(basic_block &bb)
+static int register_of(ZydisDecodedOperand &op)
+{
+    return op.type == ZYDIS_OPERAND_TYPE_REGISTER ? covirt::zydis_operand(op).register_index() : -1;
+}
+
+// recognizes the two shapes a dense `switch` is lowered to,
+//
+//   jmp [table + index*8]                      absolute entries (non-pic)
+//
+//   lea base, [rip + table]
+//   movsxd entry, dword [base + index*4]       entries relative to the table (pic)
+//   add entry, base
+//   jmp entry
+//
+// and takes the number of cases from the `cmp index, n; ja default` guarding it
+//
+static std::optional<covirt::jump_table> recover_jump_table(covirt::basic_block &bb, size_t at, const covirt::memory_reader_t &read)
+{
+    static constexpr size_t window = 16;
+    static constexpr size_t max_cases = 1024;
+
+    if (!read)
+        return {};
+
+    auto& jmp = bb[at].second;
+    covirt::zydis_operand target(jmp.operands[0]);
+
+    covirt::jump_table table{};
+    uintptr_t table_va = 0;
+    size_t entry_size = 0;
+    size_t load = at;
+
+    if (target.is_memory()) {
+        auto mem = target.as_memory();
+        if (mem.base != ZYDIS_REGISTER_NONE || mem.index == ZYDIS_REGISTER_NONE || mem.scale != 8)
+            return {};
+
+        table_va = uintptr_t(mem.disp.value);
+        entry_size = 8;
+        table.index_register = target.register_index(true);
+    }
+    else if (target.is_register() && target.size == 8) {
+        int entry = target.register_index(), base = -1;
+        size_t i = at;
+
+        for (; i-- > 0 && at - i < window;) {
+            auto& ins = bb[i].second;
+            if (ins.info.mnemonic == ZYDIS_MNEMONIC_ADD && register_of(ins.operands[0]) == entry && register_of(ins.operands[1]) >= 0) {
+                base = register_of(ins.operands[1]);
+                break;
+            }
+        }
+
+        for (load = i; base >= 0 && load-- > 0 && at - load < window;) {
+            auto& ins = bb[load].second;
+            if (ins.info.mnemonic != ZYDIS_MNEMONIC_MOVSXD || ins.operands[1].type != ZYDIS_OPERAND_TYPE_MEMORY)
+                continue;
+
+            // either register may end up holding the entry
+            //
+            covirt::zydis_operand src(ins.operands[1]);
+            auto mem = src.as_memory();
+            if (mem.base == ZYDIS_REGISTER_NONE || mem.index == ZYDIS_REGISTER_NONE || mem.scale != 4)
+                continue;
+
+            auto dst = register_of(ins.operands[0]);
+            if (dst == entry && src.register_index() == base) break;
+            if (dst == base && src.register_index() == entry) { std::swap(entry, base); break; }
+        }
+
+        if (base < 0 || load == size_t(-1) || at - load >= window)
+            return {};
+
+        table.index_register = covirt::zydis_operand(bb[load].second.operands[1]).register_index(true);
+
+        for (i = load; i-- > 0 && at - i < window;) {
+            auto& ins = bb[i].second;
+            if (ins.info.mnemonic != ZYDIS_MNEMONIC_LEA || register_of(ins.operands[0]) != base)
+                continue;
+
+            auto mem = covirt::zydis_operand(ins.operands[1]).as_memory();
+            if (mem.base == ZYDIS_REGISTER_RIP && mem.index == ZYDIS_REGISTER_NONE)
+                table_va = ins.runtime_address + ins.info.length + mem.disp.value;
+            break;
+        }
+
+        entry_size = 4;
+    }
+
+    if (!table_va)
+        return {};
+
+    // the bounds check may test a copy of the index
+    //
+    size_t count = 0;
+    int index = table.index_register;
+    for (size_t i = load; i-- > 1 && load - i < window;) {
+        auto& ins = bb[i].second;
+        auto& cmp = bb[i - 1].second;
+
+        if (ins.info.mnemonic == ZYDIS_MNEMONIC_MOV && register_of(ins.operands[0]) == index && register_of(ins.operands[1]) >= 0)
+            index = register_of(ins.operands[1]);
+
+        if (ins.info.mnemonic != ZYDIS_MNEMONIC_JNBE && ins.info.mnemonic != ZYDIS_MNEMONIC_JNB)
+            continue;
+        if (cmp.info.mnemonic != ZYDIS_MNEMONIC_CMP || register_of(cmp.operands[0]) != index || cmp.operands[1].type != ZYDIS_OPERAND_TYPE_IMMEDIATE)
+            break;
+
+        count = size_t(cmp.operands[1].imm.value.u) + (ins.info.mnemonic == ZYDIS_MNEMONIC_JNBE);
+        break;
+    }
+
+    if (count == 0 || count > max_cases)
+        return {};
+
+    for (size_t n = 0; n < count; n++) {
+        uintptr_t case_va = 0;
+        if (entry_size == 8) {
+            if (!read(table_va + n * 8, &case_va, 8))
+                return {};
+        }
+        else {
+            int32_t rel = 0;
+            if (!read(table_va + n * 4, &rel, 4))
+                return {};
+            case_va = table_va + rel;
+        }
+
+        if (case_va < bb.start_va || case_va >= bb.end_va)
+            return {};
+        table.targets.push_back(case_va);
+    }
+
+    table.index_at = bb[load].second.runtime_address;
+    return table;
+}
+
+// how far an instruction moves rsp, empty if it writes rsp in any way that
+// isn't a push, pop or add/sub of an immediate
+//
+static std::optional<int64_t> rsp_adjustment(ZydisDisassembledInstruction &ins)
+{
+    auto& dst = ins.operands[0];
+    bool dst_is_rsp = dst.type == ZYDIS_OPERAND_TYPE_REGISTER && dst.reg.value == ZYDIS_REGISTER_RSP;
+
+    switch (ins.info.mnemonic) {
+    case ZYDIS_MNEMONIC_PUSH:
+    case ZYDIS_MNEMONIC_PUSHFQ:
+        return -int64_t(ins.info.operand_width / 8);
+    case ZYDIS_MNEMONIC_POP:
+    case ZYDIS_MNEMONIC_POPFQ:
+        if (dst_is_rsp)
+            return {};
+        return int64_t(ins.info.operand_width / 8);
+    case ZYDIS_MNEMONIC_ADD:
+    case ZYDIS_MNEMONIC_SUB:
+        if (dst_is_rsp) {
+            if (ins.operands[1].type != ZYDIS_OPERAND_TYPE_IMMEDIATE)
+                return {};
+            auto imm = covirt::zydis_operand(ins.operands[1]).immediate();
+            return ins.info.mnemonic == ZYDIS_MNEMONIC_ADD ? imm : -imm;
+        }
+        break;
+    default:
+        break;
+    }
+
+    for (int i = 0; i < ins.info.operand_count; i++)
+        if (ins.operands[i].type == ZYDIS_OPERAND_TYPE_REGISTER && ins.operands[i].reg.value == ZYDIS_REGISTER_RSP && (ins.operands[i].actions & ZYDIS_OPERAND_ACTION_MASK_WRITE))
+            return {};
+
+    return 0;
+}
+
+// straight-line code ending in a plain ret, without calls, jumps or anything
+// system level; nops and endbr64 are dropped from the body. the body also has
+// to leave the return address alone and give back whatever stack it takes
+//
+static std::optional<covirt::leaf_callee> recover_leaf(uintptr_t address, size_t max_instructions, const covirt::memory_reader_t &read)
+{
+    auto code = std::make_shared<std::vector<uint8_t>>();
+    std::vector<std::pair<size_t, ZydisDisassembledInstruction>> body;
+    auto start = address;
+
+    // bytes the body has pushed below the return address
+    //
+    int64_t depth = 0;
+
+    for (size_t n = 0; n <= max_instructions; n++) {
+        uint8_t window[ZYDIS_MAX_INSTRUCTION_LENGTH];
+        size_t available = sizeof(window);
+
+        // the function may end right before the end of its section
+        //
+        while (available && !read(address, window, available))
+            available--;
+
+        ZydisDisassembledInstruction ins;
+        if (!available || !ZYAN_SUCCESS(ZydisDisassembleIntel(ZYDIS_MACHINE_MODE_LONG_64, address, window, available, &ins)))
+            return {};
+
+        switch (ins.info.meta.category) {
+        case ZYDIS_CATEGORY_RET:
+            if (ins.info.mnemonic != ZYDIS_MNEMONIC_RET || ins.info.operand_count_visible != 0 || depth != 0)
+                return {};
+            else {
+                covirt::leaf_callee leaf{ code };
+                leaf.body.start_va = start;
+                leaf.body.end_va = address;
+                for (auto& [offset, body_ins] : body)
+                    leaf.body.push_back({ code->data() + offset, body_ins });
+                return leaf;
+            }
+        case ZYDIS_CATEGORY_CALL:
+        case ZYDIS_CATEGORY_COND_BR:
+        case ZYDIS_CATEGORY_UNCOND_BR:
+        case ZYDIS_CATEGORY_SYSCALL:
+        case ZYDIS_CATEGORY_INTERRUPT:
+        case ZYDIS_CATEGORY_SYSTEM:
+            return {};
+        default:
+            break;
+        }
+
+        // rsp relative accesses may reach into the caller's frame, but not the
+        // return address
+        //
+        for (int i = 0; i < ins.info.operand_count_visible; i++) {
+            auto& mem = ins.operands[i].mem;
+            if (ins.operands[i].type != ZYDIS_OPERAND_TYPE_MEMORY || mem.base != ZYDIS_REGISTER_RSP)
+                continue;
+            if (mem.index != ZYDIS_REGISTER_NONE)
+                return {};
+
+            auto offset = mem.disp.value - depth;
+            if (offset < 8 && offset + int64_t(ins.operands[i].size / 8) > 0)
+                return {};
+        }
+
+        auto adjustment = rsp_adjustment(ins);
+        if (!adjustment.has_value())
+            return {};
+
+        depth -= adjustment.value();
+        if (depth < 0)
+            return {};
+
+        if (ins.info.mnemonic != ZYDIS_MNEMONIC_NOP && ins.info.mnemonic != ZYDIS_MNEMONIC_ENDBR64) {
+            body.push_back({ code->size(), ins });
+            code->insert(code->end(), window, window + ins.info.length);
+        }
+        address += ins.info.length;
+    }
+
+    return {};
+}
+
+covirt::subroutine covirt::decompose_bb(basic_block &bb, const memory_reader_t &read, size_t max_inline)
 {
     std::priority_queue<uintptr_t, std::vector<uintptr_t>, std::greater<uintptr_t>> visit;
     std::set<uintptr_t> addresses;
+    std::map<uintptr_t, jump_table> jump_tables;
+
+    std::map<uintptr_t, leaf_callee> leaf_callees;
 
-    for (auto& [bytes, ins] : bb)
-        if (is_jump(ins)) {
-            addresses.insert(zydis_operand(ins.operands[0]).immediate() + ins.runtime_address + ins.info.length);
+    for (size_t i = 0; i < bb.size(); i++) {
+        auto& ins = bb[i].second;
+
+        if (ins.info.mnemonic == ZYDIS_MNEMONIC_CALL && ins.operands[0].type == ZYDIS_OPERAND_TYPE_IMMEDIATE && max_inline && read) {
+            auto target = zydis_operand(ins.operands[0]).immediate() + ins.runtime_address + ins.info.length;
+            if (!leaf_callees.contains(target))
+                if (auto leaf = recover_leaf(target, max_inline, read))
+                    leaf_callees[target] = std::move(*leaf);
+        }
+
+        if (!is_jump(ins))
+            continue;
+
+        if (ins.operands[0].type == ZYDIS_OPERAND_TYPE_IMMEDIATE) {
+            // targets outside of the region are exits, they don't split a block
+            //
+            auto target = zydis_operand(ins.operands[0]).immediate() + ins.runtime_address + ins.info.length;
+            if (target >= bb.start_va && target < bb.end_va)
+                addresses.insert(target);
             if (ins.info.mnemonic != zasm::x86::Mnemonic::Jmp)
                 addresses.insert(ins.runtime_address + ins.info.length);
         }
+        else if (auto table = recover_jump_table(bb, i, read)) {
+            addresses.insert(table->targets.begin(), table->targets.end());
+            jump_tables[ins.runtime_address] = *table;
+        }
+        else {
+            out::warn("couldn't resolve the targets of the indirect jump at {}", out::address(ins.runtime_address));
+        }
+    }
 
     for (auto &a : addresses)
         visit.push(a);
@@ -25,6 +310,8 @@ covirt::subroutine covirt::decompose_bb(basic_block &bb)
     auto size = visit.size();
 
     covirt::subroutine result(bb);
+    result.jump_tables = std::move(jump_tables);
+    result.leaf_callees = std::move(leaf_callees);
     auto current = result.basic_blocks;
 
     // we need to clear because we copied 'bb', so the first
@@ -61,4 +348,79 @@ covirt::subroutine covirt::decompose_bb(basic_block &bb)
     }
 
     return result;
-}
\ No newline at end of file
+}
+
+// the slot a `call/jmp [rip + disp]` goes through
+//
+static std::optional<uintptr_t> rip_relative_slot(ZydisDisassembledInstruction &ins)
+{
+    if (ins.operands[0].type != ZYDIS_OPERAND_TYPE_MEMORY)
+        return {};
+
+    auto mem = covirt::zydis_operand(ins.operands[0]).as_memory();
+    if (mem.base != ZYDIS_REGISTER_RIP || mem.index != ZYDIS_REGISTER_NONE || mem.segment == ZYDIS_REGISTER_FS || mem.segment == ZYDIS_REGISTER_GS)
+        return {};
+
+    return ins.runtime_address + ins.info.length + mem.disp.value;
+}
+
+void covirt::resolve_imported_calls(subroutine &routine, const memory_reader_t &read, const std::map<uint64_t, std::string> &slots)
+{
+    for (auto bb = routine.basic_blocks; bb != nullptr; bb = bb->next) {
+        for (auto& [bytes, ins] : *bb) {
+            if (ins.info.mnemonic != ZYDIS_MNEMONIC_CALL)
+                continue;
+
+            auto slot = rip_relative_slot(ins);
+
+            // a stub, possibly behind an endbr64 (.plt.sec)
+            //
+            if (!slot && ins.operands[0].type == ZYDIS_OPERAND_TYPE_IMMEDIATE && read) {
+                uintptr_t address = zydis_operand(ins.operands[0]).immediate() + ins.runtime_address + ins.info.length;
+                uint8_t window[2 * ZYDIS_MAX_INSTRUCTION_LENGTH];
+                ZydisDisassembledInstruction stub;
+
+                if (!read(address, window, sizeof(window)))
+                    continue;
+                if (!ZYAN_SUCCESS(ZydisDisassembleIntel(ZYDIS_MACHINE_MODE_LONG_64, address, window, sizeof(window), &stub)))
+                    continue;
+                if (stub.info.mnemonic == ZYDIS_MNEMONIC_ENDBR64) {
+                    auto skip = stub.info.length;
+                    if (!ZYAN_SUCCESS(ZydisDisassembleIntel(ZYDIS_MACHINE_MODE_LONG_64, address + skip, window + skip, sizeof(window) - skip, &stub)))
+                        continue;
+                }
+                if (stub.info.mnemonic == ZYDIS_MNEMONIC_JMP)
+                    slot = rip_relative_slot(stub);
+            }
+
+            if (slot && slots.contains(*slot))
+                routine.imported_calls[ins.runtime_address] = slots.at(*slot);
+        }
+    }
+}
+
+std::vector<bool> covirt::live_flags(basic_block &bb)
+{
+    // CF, PF, AF, ZF, SF, OF
+    //
+    static constexpr ZydisCPUFlags arith = ZYDIS_CPUFLAG_CF | ZYDIS_CPUFLAG_PF | ZYDIS_CPUFLAG_AF | ZYDIS_CPUFLAG_ZF | ZYDIS_CPUFLAG_SF | ZYDIS_CPUFLAG_OF;
+
+    std::vector<bool> result(bb.size());
+    bool live = true;
+
+    for (size_t i = bb.size(); i-- > 0;) {
+        result[i] = live;
+
+        auto flags = bb[i].second.info.cpu_flags;
+        if (flags == nullptr)
+            continue;
+
+        auto written = flags->modified | flags->set_0 | flags->set_1 | flags->undefined;
+        if ((written & arith) == arith)
+            live = false;
+        if (flags->tested & arith)
+            live = true;
+    }
+
+    return result;
+}
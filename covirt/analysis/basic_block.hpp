@@ -1,6 +1,10 @@
 #pragma once
 
 #include <Zydis/Zydis.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace covirt {
@@ -13,6 +17,30 @@ namespace covirt {
         basic_block *next = nullptr;
     };
 
+    // a `switch` lowered to an indirect jmp through a table of case addresses
+    //
+    struct jump_table {
+        // the index register (rax = 0, ..., r15 = 15) holds the case number just
+        // before the instruction at `index_at` executes
+        //
+        uintptr_t index_at;
+        int index_register;
+
+        std::vector<uintptr_t> targets;
+    };
+
+    // reads `size` bytes at a virtual address of the binary, false if unmapped
+    //
+    using memory_reader_t = std::function<bool(uintptr_t address, void *out, size_t size)>;
+
+    // a small leaf function called from a region, lifted in place of the call;
+    // `body` excludes the final ret and points into `code`
+    //
+    struct leaf_callee {
+        std::shared_ptr<std::vector<uint8_t>> code;
+        basic_block body;
+    };
+
     class subroutine {
     public:
         subroutine() { }
@@ -30,7 +58,32 @@ namespace covirt {
 
         uint32_t offset_into_lift = 0;
         basic_block *basic_blocks = nullptr;
+
+        // recovered switch tables, keyed by the address of their jmp
+        //
+        std::map<uintptr_t, jump_table> jump_tables;
+
+        // callees to inline, keyed by their address
+        //
+        std::map<uintptr_t, leaf_callee> leaf_callees;
+
+        // the imported function called by the call at each address
+        //
+        std::map<uintptr_t, std::string> imported_calls;
     };
 
-    subroutine decompose_bb(basic_block &bb);
+    // splits `bb` at its jump targets; functions it calls which are leaves of at
+    // most `max_inline` instructions are disassembled for inlining
+    //
+    subroutine decompose_bb(basic_block &bb, const memory_reader_t &read = {}, size_t max_inline = 0);
+
+    // fills `imported_calls` with the calls of `routine` which reach an import slot,
+    // either as `call [slot]` or through a plt/thunk `jmp [slot]`
+    //
+    void resolve_imported_calls(subroutine &routine, const memory_reader_t &read, const std::map<uint64_t, std::string> &slots);
+
+    // for every instruction of `bb`, whether the arithmetic flags it leaves behind
+    // can still be read; assumed so at the end of the block
+    //
+    std::vector<bool> live_flags(basic_block &bb);
 }
@@ -1,6 +1,8 @@
 #include "binary.hpp"
 #include <utils/log.hpp>
 
+#include <cstring>
+
 covirt::binary::binary(const std::string &file) : generic(LIEF::Parser::parse(file)), out_path(file + suffix) 
 {
     switch (generic->format()) {
@@ -85,14 +87,62 @@ lief_section *covirt::binary::get_section(uint64_t address)
     }, specific);
 }
 
+bool covirt::binary::read(uint64_t address, void *out, size_t size)
+{
+    for (auto& section : sections()) {
+        auto va_start = imagebase() + section.virtual_address();
+        if (address < va_start || address + size > va_start + section.size())
+            continue;
+
+        auto content = section.content();
+        if (address - va_start + size > content.size())
+            return false;
+
+        std::memcpy(out, content.data() + (address - va_start), size);
+        return true;
+    }
+
+    return false;
+}
+
+std::map<uint64_t, std::string> covirt::binary::import_slots()
+{
+    std::map<uint64_t, std::string> slots;
+
+    std::visit([&](auto&& x) {
+        using T = std::decay_t<decltype(x)>;
+
+        if constexpr (std::is_same_v<T, LIEF::ELF::Binary*>) {
+            // lazily bound (plt) and, with -fno-plt, eagerly bound got entries
+            //
+            auto add = [&](auto&& relocations) {
+                for (auto& reloc : relocations)
+                    if (reloc.has_symbol() && !reloc.symbol()->name().empty())
+                        slots[imagebase() + reloc.address()] = reloc.symbol()->name();
+            };
+
+            add(x->pltgot_relocations());
+            add(x->dynamic_relocations());
+        }
+        else if constexpr (std::is_same_v<T, LIEF::PE::Binary*>) {
+            for (auto& import : x->imports())
+                for (auto& entry : import.entries())
+                    if (!entry.is_ordinal())
+                        slots[imagebase() + entry.iat_address()] = entry.name();
+        }
+    }, specific);
+
+    return slots;
+}
+
 void covirt::binary::update()
 {
     std::visit([this](auto&& x) { x->write(out_path); }, specific);
 }
 
-void covirt::binary::write_vm_entries(std::vector<covirt::subroutine> &routines, covirt::generic_vm_enter &vm_enter)
+void covirt::binary::write_vm_entries(std::vector<covirt::subroutine> &routines, covirt::generic_vm_enter &vm_enter, const std::string &vm_section_name)
 {
-    auto vm_section = get_section(".covirt0");
+    auto vm_section = get_section(vm_section_name);
     auto section_of_block = get_section(routines[0].start_va);
     auto base = imagebase() + section_of_block->virtual_address();
 
@@ -118,9 +168,9 @@ void covirt::binary::write_vm_entries(std::vector<covirt::subroutine> &routines,
     section_of_block->content(content);
 }
 
-void covirt::binary::write_vm_bytecode(std::vector<uint8_t> &lifted_bytes, std::vector<uint8_t> &vm_section_bytes, size_t data_start, size_t vcode_size)
+void covirt::binary::write_vm_bytecode(std::vector<uint8_t> &lifted_bytes, std::vector<uint8_t> &vm_section_bytes, size_t data_start, size_t vcode_size, const std::string &vm_section_name)
 {
-    auto vm_section = get_section(".covirt0");
+    auto vm_section = get_section(vm_section_name);
     std::memcpy(&vm_section_bytes[data_start], &lifted_bytes[0], lifted_bytes.size());
     for (int i = 0; i < vcode_size - lifted_bytes.size(); i++)
         vm_section_bytes[data_start + lifted_bytes.size() + i] = covirt::rand<uint8_t>();
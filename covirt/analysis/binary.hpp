@@ -45,9 +45,22 @@ namespace covirt {
         uint64_t imagebase();
         lief_section *get_section(const std::string &name);
         lief_section *get_section(uint64_t address);
+
+        // copies `size` bytes at virtual address `address` out of the section holding
+        // them, false if no single section does
+        //
+        bool read(uint64_t address, void *out, size_t size);
+
+        // the got (elf) or iat (pe) slot of every imported function, by address
+        //
+        std::map<uint64_t, std::string> import_slots();
+
+        // the binary follows the microsoft x64 calling convention rather than system v
+        //
+        bool is_pe() const { return std::holds_alternative<LIEF::PE::Binary*>(specific); }
         void update();
-        void write_vm_entries(std::vector<covirt::subroutine> &routines, covirt::generic_vm_enter &vm_enter);
-        void write_vm_bytecode(std::vector<uint8_t> &lifted_bytes, std::vector<uint8_t> &vm_section_bytes, size_t data_start, size_t vcode_size);
+        void write_vm_entries(std::vector<covirt::subroutine> &routines, covirt::generic_vm_enter &vm_enter, const std::string &vm_section_name = ".covirt0");
+        void write_vm_bytecode(std::vector<uint8_t> &lifted_bytes, std::vector<uint8_t> &vm_section_bytes, size_t data_start, size_t vcode_size, const std::string &vm_section_name = ".covirt0");
         
     private:
         std::string out_path;
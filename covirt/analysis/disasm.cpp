@@ -28,9 +28,17 @@ int covirt::zydis_operand::register_index(bool use_index)
 
 	out::assertion(reg != ZYDIS_REGISTER_NONE, "zydis_operand isn't a register");
 
-	if (reg >= ZYDIS_REGISTER_AL && reg <= ZYDIS_REGISTER_R15B) {
+	// zydis orders the byte registers al, cl, dl, bl, ah, ch, dh, bh, spl, bpl, sil, dil, r8b...
+	//
+	if (reg >= ZYDIS_REGISTER_AL && reg <= ZYDIS_REGISTER_BL) {
 		return reg - ZYDIS_REGISTER_AL;
 	}
+	else if (reg >= ZYDIS_REGISTER_AH && reg <= ZYDIS_REGISTER_BH) {
+		return -1;
+	}
+	else if (reg >= ZYDIS_REGISTER_SPL && reg <= ZYDIS_REGISTER_R15B) {
+		return reg - ZYDIS_REGISTER_SPL + 4;
+	}
 	else if (reg >= ZYDIS_REGISTER_AX && reg <= ZYDIS_REGISTER_R15W) {
 		return reg - ZYDIS_REGISTER_AX;
 	}
@@ -46,6 +54,56 @@ int covirt::zydis_operand::register_index(bool use_index)
 
 }
 
+bool covirt::uses_high_byte_register(ZydisDisassembledInstruction& ins)
+{
+	for (int i = 0; i < ins.info.operand_count; i++)
+		if (ins.operands[i].type == ZYDIS_OPERAND_TYPE_REGISTER && ins.operands[i].reg.value >= ZYDIS_REGISTER_AH && ins.operands[i].reg.value <= ZYDIS_REGISTER_BH)
+			return true;
+
+	return false;
+}
+
+int covirt::zydis_operand::vector_register_index()
+{
+	if (!is_register())
+		return -1;
+
+	auto reg = as_register().value;
+
+	if (reg >= ZYDIS_REGISTER_XMM0 && reg <= ZYDIS_REGISTER_XMM15) {
+		return reg - ZYDIS_REGISTER_XMM0;
+	}
+	else if (reg >= ZYDIS_REGISTER_YMM0 && reg <= ZYDIS_REGISTER_YMM15) {
+		return reg - ZYDIS_REGISTER_YMM0;
+	}
+	else {
+		return -1;
+	}
+}
+
+std::optional<uint8_t> covirt::condition_code(ZydisMnemonic mnemonic)
+{
+	switch (mnemonic) {
+	case ZYDIS_MNEMONIC_JO: case ZYDIS_MNEMONIC_SETO: case ZYDIS_MNEMONIC_CMOVO: return 0x0;
+	case ZYDIS_MNEMONIC_JNO: case ZYDIS_MNEMONIC_SETNO: case ZYDIS_MNEMONIC_CMOVNO: return 0x1;
+	case ZYDIS_MNEMONIC_JB: case ZYDIS_MNEMONIC_SETB: case ZYDIS_MNEMONIC_CMOVB: return 0x2;
+	case ZYDIS_MNEMONIC_JNB: case ZYDIS_MNEMONIC_SETNB: case ZYDIS_MNEMONIC_CMOVNB: return 0x3;
+	case ZYDIS_MNEMONIC_JZ: case ZYDIS_MNEMONIC_SETZ: case ZYDIS_MNEMONIC_CMOVZ: return 0x4;
+	case ZYDIS_MNEMONIC_JNZ: case ZYDIS_MNEMONIC_SETNZ: case ZYDIS_MNEMONIC_CMOVNZ: return 0x5;
+	case ZYDIS_MNEMONIC_JBE: case ZYDIS_MNEMONIC_SETBE: case ZYDIS_MNEMONIC_CMOVBE: return 0x6;
+	case ZYDIS_MNEMONIC_JNBE: case ZYDIS_MNEMONIC_SETNBE: case ZYDIS_MNEMONIC_CMOVNBE: return 0x7;
+	case ZYDIS_MNEMONIC_JS: case ZYDIS_MNEMONIC_SETS: case ZYDIS_MNEMONIC_CMOVS: return 0x8;
+	case ZYDIS_MNEMONIC_JNS: case ZYDIS_MNEMONIC_SETNS: case ZYDIS_MNEMONIC_CMOVNS: return 0x9;
+	case ZYDIS_MNEMONIC_JP: case ZYDIS_MNEMONIC_SETP: case ZYDIS_MNEMONIC_CMOVP: return 0xa;
+	case ZYDIS_MNEMONIC_JNP: case ZYDIS_MNEMONIC_SETNP: case ZYDIS_MNEMONIC_CMOVNP: return 0xb;
+	case ZYDIS_MNEMONIC_JL: case ZYDIS_MNEMONIC_SETL: case ZYDIS_MNEMONIC_CMOVL: return 0xc;
+	case ZYDIS_MNEMONIC_JNL: case ZYDIS_MNEMONIC_SETNL: case ZYDIS_MNEMONIC_CMOVNL: return 0xd;
+	case ZYDIS_MNEMONIC_JLE: case ZYDIS_MNEMONIC_SETLE: case ZYDIS_MNEMONIC_CMOVLE: return 0xe;
+	case ZYDIS_MNEMONIC_JNLE: case ZYDIS_MNEMONIC_SETNLE: case ZYDIS_MNEMONIC_CMOVNLE: return 0xf;
+	default: return {};
+	}
+}
+
 void covirt::disasm(std::span<const uint8_t> content, uint64_t base_address, std::function<void(uint64_t, ZydisDisassembledInstruction)> callback)
 {
 	ZydisDisassembledInstruction ins;
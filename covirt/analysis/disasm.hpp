@@ -7,6 +7,7 @@
 
 #include <span>
 #include <functional>
+#include <optional>
 #include <variant>
 
 #include <zasm/zasm.hpp>
@@ -37,7 +38,14 @@ namespace covirt {
         constexpr auto as_immediate() { return std::get<zydis_imm>(value); }
         constexpr auto as_memory() {    return std::get<zydis_mem>(value); }
 
+        // index of the full width register (rax = 0, ..., r15 = 15), -1 for
+        // ah/ch/dh/bh which don't have one of their own
+        //
         int register_index(bool use_index = false);
+
+        // 0-15 for xmm/ymm registers, -1 otherwise
+        //
+        int vector_register_index();
         
     	int64_t immediate()
         {
@@ -46,6 +54,14 @@ namespace covirt {
         }
     };
 
+    // ah, ch, dh or bh appear as an operand
+    //
+    bool uses_high_byte_register(ZydisDisassembledInstruction &ins);
+
+    // x86 condition code (the `cc` nibble of jcc/setcc/cmovcc) of a conditional instruction
+    //
+    std::optional<uint8_t> condition_code(ZydisMnemonic mnemonic);
+
     void disasm(std::span<const uint8_t> content, uint64_t base_address, std::function<void(uint64_t, ZydisDisassembledInstruction)> callback);
 
     constexpr bool is_jump(ZydisDisassembledInstruction &ins) { return ins.info.mnemonic >= zasm::x86::Mnemonic::Jb && ins.info.mnemonic <= zasm::x86::Mnemonic::Jz; }
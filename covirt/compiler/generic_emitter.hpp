@@ -1,22 +1,74 @@
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <cstdint>
+#include <map>
+#include <numeric>
 #include <vector>
 #include <variant>
 
 #include <utils/log.hpp>
+#include <utils/rand.hpp>
 
 namespace covirt {
+    // physical encoding of every opcode, so that separate vms don't share
+    // the same instruction set
+    //
+    using opcode_map_t = std::array<uint8_t, 64>;
+
+    inline opcode_map_t identity_opcode_map()
+    {
+        opcode_map_t map;
+        std::iota(map.begin(), map.end(), 0);
+        return map;
+    }
+
+    inline opcode_map_t random_opcode_map()
+    {
+        auto map = identity_opcode_map();
+        for (int i = int(map.size()) - 1; i > 0; i--)
+            std::swap(map[i], map[covirt::rand<uint32_t>() % (i + 1)]);
+        return map;
+    }
+
     class generic_emitter {
     protected:
         std::vector<uint8_t> bytes;
         int count = 0;
         int cached_size = 0;
 
+        // number of times each encoded opcode (size bits included) was emitted,
+        // keyed by the opcode before it goes through `opcode_map`
+        //
+        std::map<uint8_t, std::size_t> histogram;
+
+        opcode_map_t opcode_map = identity_opcode_map();
+
     public:
+        // what `restore` rolls the emitter back to, for lifts that turn out unusable
+        //
+        struct checkpoint {
+            std::size_t size;
+            int count;
+            std::map<uint8_t, std::size_t> histogram;
+        };
+
+        checkpoint save() const { return { bytes.size(), count, histogram }; }
+
+        void restore(const checkpoint &at)
+        {
+            bytes.resize(at.size);
+            count = at.count;
+            histogram = at.histogram;
+        }
+
         constexpr std::vector<uint8_t>& get() { return bytes; }
         constexpr int get_count() const { return count; }
+        constexpr auto& get_histogram() const { return histogram; }
+        constexpr auto& get_opcode_map() const { return opcode_map; }
+
+        void set_opcode_map(const opcode_map_t &map) { opcode_map = map; }
 
         template <typename O, typename S, typename... Tx>
         std::vector<uint8_t> emit(O opcode, S size, Tx&&... args)
@@ -46,7 +98,10 @@ namespace covirt {
             };
 
             count++;
-            return static_cast<uint8_t>(uint8_t(opcode) | encode_size(size, cached_size));
+
+            auto encoded = static_cast<uint8_t>(uint8_t(opcode) | encode_size(size, cached_size));
+            histogram[encoded]++;
+            return static_cast<uint8_t>(opcode_map[encoded & 0b00111111] | (encoded & 0b11000000));
         }
 
         template <typename T>
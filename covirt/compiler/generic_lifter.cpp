@@ -4,6 +4,8 @@
 #include <utils/log.hpp>
 #include <covirt_stub.h>
 
+#include <memory>
+
 // clear??
 //
 static inline covirt::basic_block *get_bb_which_address_resides_in(covirt::subroutine &routine, uintptr_t addr)
@@ -23,63 +25,152 @@ covirt::lift_result covirt::lift(std::vector<covirt::subroutine> &routines, gene
 
     auto vm_entry_length = vm.get_vm_enter().get_length();
 
+    // jcc targets outside of a region get a `vm_exit` after the region's bytecode,
+    // these stand in for the basic block they jump to
+    //
+    std::vector<std::unique_ptr<basic_block>> exit_stubs;
+
     for (auto & bb_routine : routines) {
         auto bb_length = bb_routine.length() + __covirt_vm_stub_length + __covirt_vm_stub_length;
         auto bb_unused_length = bb_length - vm_entry_length;
 
         bb_routine.offset_into_lift = lifter.get_emitter().get().size();
 
+        auto retaddr = bb_routine.start_va - __covirt_vm_stub_length + vm_entry_length;
+        std::map<uintptr_t, basic_block*> exits;
+
+        // false, with nothing emitted, if it has no handler and `allow_native` is not set
+        //
+        auto lift_instruction = [&](uint8_t *bytes, ZydisDisassembledInstruction &ins, bool live, bool allow_native = true) {
+            auto fn_translate = table[ins.info.mnemonic];
+
+            // the vm's registers have no way of addressing bits 8-15 on their own
+            //
+            bool liftable_and_lifted = fn_translate != nullptr && !uses_high_byte_register(ins);
+
+            if (liftable_and_lifted) {
+                zydis_operand dst(ins.operands[0]);
+                zydis_operand src(ins.operands[1]);
+
+                if (is_jump(ins) && dst.is_immediate()) {
+                    auto target = dst.immediate() + ins.runtime_address + ins.info.length;
+                    dst.references_bb = get_bb_which_address_resides_in(bb_routine, target);
+
+                    // leaving the region (early returns, gotos, tail jumps), an
+                    // unconditional jump is the exit itself
+                    //
+                    if (dst.references_bb.value() == nullptr) {
+                        if (ins.info.mnemonic == ZYDIS_MNEMONIC_JMP) {
+                            lifter.vm_exit(int32_t(target - retaddr));
+                            return;
+                        }
+
+                        if (!exits.contains(target)) {
+                            exit_stubs.push_back(std::make_unique<basic_block>());
+                            exit_stubs.back()->start_va = exit_stubs.back()->end_va = target;
+                            exits[target] = exit_stubs.back().get();
+                        }
+                        dst.references_bb = exits[target];
+                    }
+                }
+                else if (ins.info.mnemonic == ZYDIS_MNEMONIC_CALL && dst.is_immediate()) {
+                    // same concept as before, we need an rva relative to the retaddr
+                    //
+                    dst.references_rva = ((ins.runtime_address + dst.immediate()) - retaddr + ins.info.length);
+                }
+
+                lifter.set_instruction(&ins, retaddr, live);
+                if (!fn_translate(dst, src))
+                    liftable_and_lifted = false;
+            }
+
+            if (!liftable_and_lifted) {
+                if (!allow_native)
+                    return false;
+
+                // a jump run natively never comes back to the vm
+                //
+                out::assertion(!is_jump(ins), "unsupported indirect jump '{}'", out::name(ins.text));
+
+                lifter.native(bytes, ins.info.length);
+                out::warn("instruction '{}' has no defined vm handler, will execute natively", out::name(ins.text));
+            }
+            return true;
+        };
+
         for (auto bb = bb_routine.basic_blocks; bb != nullptr; bb = bb->next) {
             bb->offset_into_lift = lifter.get_emitter().get().size();
 
-            int skip = 0;
-            for (auto& [bytes, ins] : *bb) {
-                auto fn_translate = table[ins.info.mnemonic];
-                auto retaddr = bb_routine.start_va - __covirt_vm_stub_length + vm_entry_length;
+            auto live = live_flags(*bb);
 
-                bool liftable_and_lifted = fn_translate != nullptr;
+            int skip = 0;
+            for (size_t i = 0; i < bb->size(); i++) {
+                auto& [bytes, ins] = (*bb)[i];
 
                 dump_index_table[lifter.get_emitter().get_count()] = ins.text;
 
-                if (liftable_and_lifted) {
-                    zydis_operand dst(ins.operands[0]);
-                    zydis_operand src(ins.operands[1]);
+                for (auto& [at, table] : bb_routine.jump_tables)
+                    if (table.index_at == ins.runtime_address)
+                        lifter.jump_table_index(table.index_register);
 
-                    if (is_jump(ins)) {
-                        dst.references_bb = get_bb_which_address_resides_in(bb_routine, dst.immediate() + ins.runtime_address + ins.info.length);
-                        out::assertion(dst.references_bb.value() != nullptr, "attempted to jump out of the protected region");
-                    }
-                    else if (ins.info.mnemonic == ZYDIS_MNEMONIC_LEA && src.is_memory()) {
-                        // assumes 'base' is rip, because if it isn't fn_translate will fail
-                        //
-                        // we want to translate the rva from:
-                        // [rva relative to current rip] => [rva relative to retaddr]
-                        //
-                        // (old_addr+old_disp)−(new_addr)
-                        // + ins.info.length so that we don't have to calc in the vm
-
-                        dst.references_rva = (ins.runtime_address + src.as_memory().disp.value) - retaddr + ins.info.length;
-                    }
-                    else if (ins.info.mnemonic == ZYDIS_MNEMONIC_CALL) {
-                        // same concept as before, we need an rva relative to the retaddr
-                        //
-                        dst.references_rva = ((ins.runtime_address + dst.immediate()) - retaddr + ins.info.length);
-                    }
+                if (bb_routine.jump_tables.contains(ins.runtime_address)) {
+                    std::vector<basic_block*> targets;
+                    for (auto target : bb_routine.jump_tables[ins.runtime_address].targets)
+                        targets.push_back(get_bb_which_address_resides_in(bb_routine, target));
 
-                    if (!fn_translate(dst, src))
-                        liftable_and_lifted = false;
+                    lifter.jump_table(targets);
+                    skip += ins.info.length;
+                    continue;
                 }
 
-                if (!liftable_and_lifted) {
-                    lifter.native(bytes, ins.info.length);
-                    out::warn("instruction '{}' has no defined vm handler, will execute natively", out::name(ins.text));
+                if (bb_routine.imported_calls.contains(ins.runtime_address) && lifter.intrinsic(bb_routine.imported_calls[ins.runtime_address])) {
+                    skip += ins.info.length;
+                    continue;
                 }
 
+                // small leaf functions are lifted in place of the call, which saves
+                // leaving and reentering the vm around them. the body would run from
+                // the vm section if any of it went native, so then it's called as usual
+                //
+                if (ins.info.mnemonic == ZYDIS_MNEMONIC_CALL && ins.operands[0].type == ZYDIS_OPERAND_TYPE_IMMEDIATE) {
+                    auto target = zydis_operand(ins.operands[0]).immediate() + ins.runtime_address + ins.info.length;
+
+                    if (bb_routine.leaf_callees.contains(target)) {
+                        auto& callee = bb_routine.leaf_callees[target].body;
+                        auto callee_live = live_flags(callee);
+
+                        auto checkpoint = lifter.get_emitter().save();
+                        bool inlined = true;
+
+                        lifter.enter_inline(int32_t(ins.runtime_address + ins.info.length - retaddr));
+                        for (size_t j = 0; j < callee.size() && inlined; j++) {
+                            dump_index_table[lifter.get_emitter().get_count()] = callee[j].second.text;
+                            inlined = lift_instruction(callee[j].first, callee[j].second, callee_live[j], false);
+                        }
+
+                        if (inlined) {
+                            lifter.leave_inline();
+                            skip += ins.info.length;
+                            continue;
+                        }
+
+                        lifter.get_emitter().restore(checkpoint);
+                        dump_index_table.erase(dump_index_table.upper_bound(checkpoint.count), dump_index_table.end());
+                        dump_index_table[checkpoint.count] = ins.text;
+                    }
+                }
+
+                lift_instruction(bytes, ins, live[i]);
                 skip += ins.info.length;
             }
         }
 
         lifter.vm_exit(bb_unused_length);
+
+        for (auto [target, stub] : exits) {
+            stub->offset_into_lift = lifter.get_emitter().get().size();
+            lifter.vm_exit(int32_t(target - retaddr));
+        }
     }
 
     // fill in jumps inside of the lifted bytecode
@@ -93,7 +184,16 @@ covirt::lift_result covirt::lift(std::vector<covirt::subroutine> &routines, gene
 
     out::info("generated {} total vm instructions", out::value(lifter.get_emitter().get_count()));
 
+    // strip the size bits, handlers deal with every size themselves
+    //
+    handler_profile_t profile;
+    std::set<uint8_t> variants;
+    for (auto [encoded, n] : lifter.get_emitter().get_histogram()) {
+        profile[encoded & 0b00111111] += n;
+        variants.insert(encoded);
+    }
+
     // to-do: the copy here is sub-optimal, pass around as reference instead without crashing?
     //
-    return covirt::lift_result{ lifter.get_emitter().get(), dump_index_table };
+    return covirt::lift_result{ lifter.get_emitter().get(), dump_index_table, profile, variants, lifter.get_emitter().get_opcode_map() };
 }
\ No newline at end of file
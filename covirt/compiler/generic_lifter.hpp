@@ -18,6 +18,18 @@ namespace covirt {
     struct lift_result {
         std::vector<uint8_t> bytes;
         dump_index_table_t dump_index_table;
+
+        // how many times each handler is referenced by the bytecode
+        //
+        handler_profile_t profile;
+
+        // every size variant (opcode | size bits) referenced by the bytecode
+        //
+        std::set<uint8_t> variants;
+
+        // encoding used for the opcodes in `bytes`
+        //
+        opcode_map_t opcode_map;
     };
 
     class generic_lifter {
@@ -38,13 +50,57 @@ namespace covirt {
         };
 
         std::vector<fill_in_data> fill_in_gaps;
+
+        // instruction currently being translated, for translators which need more
+        // than the first two operands, and the address rvas are relative to
+        //
+        ZydisDisassembledInstruction *instruction = nullptr;
+        uintptr_t retaddr = 0;
+
+        // false if nothing reads the flags `instruction` writes, so translators
+        // can pick a form which doesn't compute them
+        //
+        bool flags_live = true;
+
+        // arguments are passed in rcx, rdx, r8, r9 instead of rdi, rsi, rdx, rcx, ...
+        //
+        bool windows_abi = false;
     public:
         virtual std::map<ZydisMnemonic, fn_instruction_translator_t>& get_translation_table() = 0;
-        virtual void vm_exit(uint16_t bytes_to_skip) = 0;
+        // leaves the vm, continuing natively at `rva` relative to the retaddr
+        //
+        virtual void vm_exit(int32_t rva) = 0;
         virtual void native(uint8_t *ins_bytes, size_t length) = 0;
+
+        // saves the case number of a switch before its table load overwrites it,
+        // `jump_table` consumes it at the jmp
+        //
+        virtual void jump_table_index(int index_register) = 0;
+        virtual void jump_table(std::vector<basic_block*> &targets) = 0;
+
+        // bracket the body of a leaf callee lifted in place of its call; the return
+        // address (`return_rva` relative to the retaddr) is still pushed so the
+        // callee sees the stack it expects, and its ret is replaced by the pop
+        //
+        virtual void enter_inline(int32_t return_rva) = 0;
+        virtual void leave_inline() = 0;
+
+        // replaces a call to the imported function `name` with a built-in
+        // implementation, false if there's none
+        //
+        virtual bool intrinsic(const std::string &name) = 0;
         virtual generic_emitter& get_emitter() = 0;
 
         auto get_fill_in_gaps() { return fill_in_gaps; }
+
+        void set_windows_abi(bool ms) { windows_abi = ms; }
+
+        void set_instruction(ZydisDisassembledInstruction *ins, uintptr_t ret, bool live = true)
+        {
+            instruction = ins;
+            retaddr = ret;
+            flags_live = live;
+        }
     };
 
     lift_result lift(std::vector<covirt::subroutine> &routines, covirt::generic_lifter &lifter, covirt::generic_vm &vm);
@@ -1,24 +1,99 @@
 #include "generic_vm.hpp"
 #include <utils/log.hpp>
 
+#include <algorithm>
+
 constexpr std::size_t page_size = 4096;
 #define PAGE_ROUND_DOWN(x) (x & (~(page_size-1)))
 #define PAGE_ROUND_UP(x) ((x + page_size-1) & (~(page_size-1))) 
 
+std::size_t covirt::generic_vm::get_heat(uint8_t opcode)
+{
+    auto& expected = get_expected_profile();
+
+    // handlers we never expect to be hot (enter, exit, native...) stay cold even
+    // if they show up in a profile
+    //
+    if (!expected.contains(opcode) || expected[opcode] == 0)
+        return 0;
+
+    if (!profile.has_value())
+        return expected[opcode];
+
+    return profile->contains(opcode) ? profile->at(opcode) : 0;
+}
+
+bool covirt::generic_vm::replicates_dispatch()
+{
+    if (!assembling.has_value() || assembling.value() == get_handlers().begin()->first)
+        return true;
+
+    switch (dispatch) {
+    case dispatch_mode::central: return false;
+    case dispatch_mode::hybrid: return hottest.contains(assembling.value());
+    default: return true;
+    }
+}
+
 std::pair<std::vector<uint8_t>, std::size_t> covirt::generic_vm::assemble(std::vector<generic_transform_pass*> &passes)
 {
     zasm::Program program(zasm::MachineMode::AMD64);
     zasm::x86::Assembler assembler(program);
     zasm::Serializer serializer{};
 
+    auto& handlers = get_handlers();
+
+    // vm_enter stubs call the very start of the section, so the entry handler
+    // (lowest opcode) always has to be emitted first
+    //
+    auto entry = handlers.begin()->first;
+
+    // hot handlers get clustered at the front, hottest first, each starting on
+    // its own aligned boundary. cold handlers are packed after them so they
+    // don't spread the hot working set over more i-cache lines
+    //
+    std::vector<uint8_t> hot, cold;
+    for (auto opcode : handlers | std::views::keys) {
+        if (opcode != entry && is_handler_used(opcode))
+            (get_heat(opcode) ? hot : cold).push_back(opcode);
+    }
+
+    std::ranges::stable_sort(hot, std::greater{}, [&](uint8_t opcode) { return get_heat(opcode); });
+
+    hottest.clear();
+    for (size_t i = 0; i < std::min(hybrid_replicated, hot.size()); i++)
+        hottest.insert(hot[i]);
+
     initialize(assembler);
-    for (auto& handler : get_handlers() | std::views::values)
-        handler(assembler);
+    assembling = entry;
+    handlers[entry](assembler);
+    for (auto opcode : hot) {
+        if (handler_alignment > 1)
+            assembler.align(zasm::Align::Type::Code, int32_t(handler_alignment));
+        assembling = opcode;
+        handlers[opcode](assembler);
+    }
+    for (auto opcode : cold) {
+        assembling = opcode;
+        handlers[opcode](assembler);
+    }
+    assembling.reset();
+
+    // the passes only rewrite instructions, so the label node is still there
+    // to continue from once they're done
+    //
+    auto unobfuscated = assembler.createLabel();
+    assembler.bind(unobfuscated);
+    auto unobfuscated_at = assembler.getCursor();
+
     finalize(assembler);
 
     for (auto &apply_transform : passes)
         apply_transform->pass(program, assembler);
 
+    assembler.setCursor(unobfuscated_at);
+    emit_unobfuscated(assembler);
+
     const auto res = serializer.serialize(program, 0);
     out::assertion(res == zasm::ErrorCode::None, "failed to serialize vm: {}:{}", res.getErrorName(), res.getErrorMessage());
 
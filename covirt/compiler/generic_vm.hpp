@@ -1,5 +1,6 @@
 #pragma once
 
+#include "generic_emitter.hpp"
 #include "generic_vm_enter.hpp"
 
 #include <utils/rand.hpp>
@@ -7,7 +8,9 @@
 
 #include <functional>
 #include <map>
+#include <optional>
 #include <print>
+#include <set>
 #include <zasm/zasm.hpp>
 
 namespace covirt {
@@ -21,6 +24,20 @@ namespace covirt {
     };
     
     using fn_vm_handler_t = std::function<void(zasm::x86::Assembler &)>;
+
+    // relative execution frequency of each handler, used to lay out the vm. a
+    // handler with a frequency of 0 is considered cold
+    //
+    using handler_profile_t = std::map<uint8_t, std::size_t>;
+
+    // where handlers dispatch the next instruction: each from its own copy of the
+    // dispatch (one indirect branch per handler for the predictor, but every copy
+    // gets obfuscated), all through one shared copy, or own copies in the hottest
+    // handlers only
+    //
+    enum class dispatch_mode {
+        replicated, central, hybrid
+    };
     
     // to-do: support opcodes beyond uint8_t?
     //
@@ -38,6 +55,11 @@ namespace covirt {
         // 
         virtual void finalize(zasm::x86::Assembler &a) = 0;
 
+        // code the transform passes must not touch, emitted after they ran at the
+        // end of the handlers
+        //
+        virtual void emit_unobfuscated(zasm::x86::Assembler &a) {}
+
         // get the vm_enter emitter
         //
         virtual generic_vm_enter& get_vm_enter() = 0;
@@ -50,8 +72,74 @@ namespace covirt {
         //
         virtual void set_stack_size(size_t size) = 0;
 
+        // expected frequency of each handler, used when no profile is given
+        //
+        virtual handler_profile_t& get_expected_profile() = 0;
+
+        // align hot handler entry points to this many bytes (0 or 1 disables)
+        //
+        void set_handler_alignment(size_t alignment) { handler_alignment = alignment; }
+
+        // override the expected frequencies, i.e. with counts from lifted code
+        //
+        void set_profile(const handler_profile_t &p) { profile = p; }
+
+        // only assemble these handlers (plus the entry handler), everything
+        // else gets dropped from the vm
+        //
+        void set_used_handlers(const std::set<uint8_t> &used) { used_handlers = used; }
+
+        bool is_handler_used(uint8_t opcode)
+        {
+            return !used_handlers.has_value() || used_handlers->contains(opcode) || opcode == get_handlers().begin()->first;
+        }
+
+        // only assemble these size variants (opcode | size bits) of sized
+        // handlers, the rest trap
+        //
+        void set_used_variants(const std::set<uint8_t> &used) { used_variants = used; }
+
+        bool is_variant_used(uint8_t opcode, int size_bits)
+        {
+            return !used_variants.has_value() || used_variants->contains(uint8_t(opcode | (size_bits << 6)));
+        }
+
+        // in `hybrid` mode, the `replicated` hottest handlers keep their own dispatch
+        //
+        void set_dispatch(dispatch_mode mode, std::size_t replicated = 8)
+        {
+            dispatch = mode;
+            hybrid_replicated = replicated;
+        }
+
+        // must match the map given to the emitter of the bytecode this vm runs
+        //
+        void set_opcode_map(const opcode_map_t &map) { opcode_map = map; }
+
+        uint8_t get_encoding(uint8_t opcode) const { return opcode_map[opcode]; }
+
         // assemble
         //
         std::pair<std::vector<uint8_t>, std::size_t> assemble(std::vector<generic_transform_pass*> &transform_passes);
+
+    protected:
+        // whether the handler being assembled ends in its own copy of the dispatch,
+        // the entry handler always does as it holds the shared one
+        //
+        bool replicates_dispatch();
+
+        std::size_t handler_alignment = 64;
+        dispatch_mode dispatch = dispatch_mode::replicated;
+        std::size_t hybrid_replicated = 8;
+        std::optional<handler_profile_t> profile;
+        std::optional<std::set<uint8_t>> used_handlers;
+        std::optional<std::set<uint8_t>> used_variants;
+        opcode_map_t opcode_map = identity_opcode_map();
+
+    private:
+        std::size_t get_heat(uint8_t opcode);
+
+        std::optional<uint8_t> assembling;
+        std::set<uint8_t> hottest;
     };
 }
\ No newline at end of file
@@ -7,12 +7,19 @@
 #include <utils/argparse.hpp>
 
 #include <filesystem>
+#include <set>
 #include "version.h"
 
 int main(int argc, char **argv)
 {
     int stack_size = 0;
     int code_size = 0;
+    int handler_alignment = 0;
+    int regions_per_vm = 0;
+    int max_inline = 0;
+    int jit_threshold = 0;
+    int jit_cache_size = 0;
+    int hybrid_dispatch = 0;
 
     argparse::ArgumentParser program("covirt", COVIRT_VERSION);
     program.add_argument("file_input").help("path to input binary to virtualize").metavar("INPUT_PATH");
@@ -32,6 +39,48 @@ int main(int argc, char **argv)
            .metavar("SIZE")
            .nargs(1)
            .store_into(stack_size);
+    program.add_argument("-halign", "--handler_alignment")
+           .default_value(int(64))
+           .help("align hot vm handlers to this many bytes, 0 to disable")
+           .metavar("BYTES")
+           .nargs(1)
+           .store_into(handler_alignment);
+    program.add_argument("-rpv", "--regions_per_vm")
+           .default_value(int(0))
+           .help("emit a separate, specialized vm for every N regions, 0 to share one vm")
+           .metavar("N")
+           .nargs(1)
+           .store_into(regions_per_vm);
+    program.add_argument("-inline", "--inline_leaf_size")
+           .default_value(int(0))
+           .help("lift called leaf functions of up to this many instructions in place of the call, 0 to disable")
+           .metavar("N")
+           .nargs(1)
+           .store_into(max_inline);
+    program.add_argument("-jit", "--jit_threshold")
+           .default_value(int(0))
+           .help("translate a region into native code at runtime once it was entered N times, 0 to disable (ELF only)")
+           .metavar("N")
+           .nargs(1)
+           .store_into(jit_threshold);
+    program.add_argument("-jcache", "--jit_cache_size")
+           .default_value(int(0x100000))
+           .help("size of the cache the translations live in, flushed whenever it runs full")
+           .metavar("BYTES")
+           .nargs(1)
+           .store_into(jit_cache_size);
+    program.add_argument("-dispatch", "--dispatch")
+           .default_value(std::string("replicated"))
+           .choices("replicated", "central", "hybrid")
+           .help("dispatch the next instruction from every handler, from one shared dispatcher, or from the hottest handlers only")
+           .metavar("MODE")
+           .nargs(1);
+    program.add_argument("-hdispatch", "--hybrid_dispatch_handlers")
+           .default_value(int(8))
+           .help("number of hottest handlers keeping their own dispatch in hybrid mode")
+           .metavar("N")
+           .nargs(1)
+           .store_into(hybrid_dispatch);
     program.add_argument("-no_smc", "--no_self_modifying_code")
            .default_value(false)
            .implicit_value(true)
@@ -64,21 +113,6 @@ int main(int argc, char **argv)
     covirt::binary file(input_file_path);
     try { file.set_out_path(program.get("-o")); } catch (...) { }
 
-    covirt::vm::v0_vm x;
-    x.set_code_size(uint32_t(code_size));
-    x.set_stack_size(uint32_t(stack_size));
-
-    std::vector<covirt::generic_transform_pass*> passes;
-
-    if (!program.get<bool>("-no_smc")) passes.push_back(new covirt::smc_pass());
-    if (!program.get<bool>("-no_mba")) passes.push_back(new covirt::mba_pass());
-
-    if (!passes.empty()) out::info("obfuscating virtual machine...");
-    else out::warn("assembling vm without any obfuscation passes");
-
-    auto [bytes, data_start] = x.assemble(passes);
-    file.add_section(".covirt0", bytes, true, true);
-
     std::vector<covirt::basic_block> basic_blocks;
     for (auto& section : file.sections()) {
         if (file.is_section_executable(section)) {
@@ -110,9 +144,14 @@ int main(int argc, char **argv)
 
     out::assertion(!basic_blocks.empty(), "found no code markers in binary");
 
+    covirt::memory_reader_t read = [&](uintptr_t address, void *out, size_t size) { return file.read(address, out, size); };
+    auto import_slots = file.import_slots();
+
     std::vector<covirt::subroutine> routines;
-    for (auto& bb : basic_blocks)
-        routines.push_back(decompose_bb(bb));
+    for (auto& bb : basic_blocks) {
+        routines.push_back(decompose_bb(bb, read, size_t(std::max(max_inline, 0))));
+        resolve_imported_calls(routines.back(), read, import_slots);
+    }
     
     size_t count = 0;
     for (auto& r : routines)
@@ -121,16 +160,101 @@ int main(int argc, char **argv)
 
     out::info("found {} regions which decomposed into {} total basic blocks", out::value(basic_blocks.size()), out::value(count));
 
-    covirt::vm::v0_lifter lifter;
-    auto lifted = lift(routines, lifter, x);
+    // regions are split into groups which each get their own vm, only containing
+    // what that group uses and with its own opcode assignment. by default every
+    // region shares a single vm
+    //
+    auto group_size = regions_per_vm > 0 ? size_t(regions_per_vm) : routines.size();
+    auto specialize = group_size < routines.size();
+
+    struct vm_group {
+        std::vector<covirt::subroutine> routines;
+        covirt::lift_result lifted;
+    };
+
+    // everything gets lifted before the binary is modified, as the basic blocks
+    // point into section content owned by lief
+    //
+    std::vector<vm_group> groups;
+    for (size_t first = 0; first < routines.size(); first += group_size) {
+        std::vector<covirt::subroutine> group(routines.begin() + first, routines.begin() + std::min(first + group_size, routines.size()));
+
+        covirt::vm::v0_vm x;
+        covirt::vm::v0_lifter lifter;
+        lifter.set_windows_abi(file.is_pe());
+        if (specialize)
+            lifter.get_emitter().set_opcode_map(covirt::random_opcode_map());
+
+        auto lifted = lift(group, lifter, x);
 
-    out::assertion(lifted.bytes.size() < code_size, "ran out of code space, try using '-vcode {}'", lifted.bytes.size() + 1);
+        out::assertion(lifted.bytes.size() < code_size, "ran out of code space, try using '-vcode {}'", lifted.bytes.size() + 1);
 
-    if (program.get<bool>("-d"))
-        covirt::vm::debug::dump_v0(lifted);
+        if (program.get<bool>("-d"))
+            covirt::vm::debug::dump_v0(lifted);
 
-    file.write_vm_entries(routines, x.get_vm_enter());
-    file.write_vm_bytecode(lifted.bytes, bytes, data_start, code_size);
+        groups.push_back({ group, lifted });
+    }
+
+    // the translations are mapped with the linux mmap/mprotect syscalls
+    //
+    auto jit = jit_threshold > 0 && !file.is_pe();
+    if (jit_threshold > 0 && file.is_pe())
+        out::warn("the jit tier is only supported for ELF binaries, ignoring '-jit'");
+    if (jit)
+        out::assertion(jit_cache_size > 0 && jit_cache_size <= 0x40000000, "jit cache size must be between 1 byte and 1 GiB");
+
+    std::vector<covirt::generic_transform_pass*> passes;
+
+    if (!program.get<bool>("-no_smc")) passes.push_back(new covirt::smc_pass());
+    if (!program.get<bool>("-no_mba")) passes.push_back(new covirt::mba_pass());
+
+    auto dispatch_name = program.get<std::string>("-dispatch");
+    auto dispatch = dispatch_name == "central" ? covirt::dispatch_mode::central
+                  : dispatch_name == "hybrid" ? covirt::dispatch_mode::hybrid
+                  : covirt::dispatch_mode::replicated;
+
+    for (size_t index = 0; index < groups.size(); index++) {
+        auto& [group, lifted] = groups[index];
+        auto section_name = std::format(".covirt{}", index);
+
+        covirt::vm::v0_vm x;
+        x.set_code_size(uint32_t(code_size));
+        x.set_stack_size(uint32_t(stack_size));
+        x.set_handler_alignment(size_t(std::max(handler_alignment, 0)));
+        x.set_opcode_map(lifted.opcode_map);
+        x.set_dispatch(dispatch, size_t(std::max(hybrid_dispatch, 0)));
+
+        // only assemble (and obfuscate) the handlers and size variants the lifted
+        // bytecode uses, and lay them out by how often they were emitted
+        //
+        std::set<uint8_t> used_handlers;
+        for (auto opcode : lifted.profile | std::views::keys)
+            used_handlers.insert(opcode);
+
+        if (jit) {
+            std::vector<uint32_t> entries;
+            for (auto& routine : group)
+                entries.push_back(routine.offset_into_lift);
+
+            x.set_jit(size_t(jit_threshold), size_t(jit_cache_size), entries, lifted.bytes.size());
+            used_handlers.insert(uint8_t(covirt::vm::v0_op::jit_resume));
+        }
+
+        x.set_used_handlers(used_handlers);
+        x.set_used_variants(lifted.variants);
+        x.set_profile(lifted.profile);
+
+        out::info("assembling {} of {} vm handlers into '{}'", out::value(used_handlers.size() + 1), out::value(x.get_handlers().size()), out::name(section_name));
+
+        if (!passes.empty()) out::info("obfuscating virtual machine...");
+        else out::warn("assembling vm without any obfuscation passes");
+
+        auto [bytes, data_start] = x.assemble(passes);
+        file.add_section(section_name, bytes, true, true);
+
+        file.write_vm_entries(group, x.get_vm_enter(), section_name);
+        file.write_vm_bytecode(lifted.bytes, bytes, data_start, code_size, section_name);
+    }
 
     out::ok("virtualization complete");
 }
\ No newline at end of file
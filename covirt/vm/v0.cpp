@@ -1,55 +1,36 @@
 #include "v0.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <stack>
 #include <utils/log.hpp>
 
-void covirt::vm::v0_lifter::push_address(covirt::zydis_operand& operand)
+void covirt::vm::v0_lifter::push_address(covirt::zydis_operand& operand, bool segment)
 {
-	//[base+disp]<--done
-	//[index*scale+disp]<--done
-	//[base+index*scale]<--done
-	//[base+index*scale+disp]<--done
-
 	const auto mem = operand.as_memory();
-	int add_argc = 0;
-	if (mem.index != ZYDIS_REGISTER_NONE)
-	{
-		e.push_reg(8, static_cast<uint8_t>(operand.register_index(true)));
-		for (auto i = 1;i < mem.scale;i++)
-		{
-			//1 2 4 8
-			e.push_reg(8, static_cast<uint8_t>(operand.register_index(true)));
-			e.add(8);
-
-			if (add_argc) {
-				e.pop(8, static_cast<uint8_t>(14));
-				e.push_reg(8, static_cast<uint8_t>(14));
-			}
-			add_argc++;
-		}
-		add_argc++;
-	}
-	if (mem.base != ZYDIS_REGISTER_NONE)
-	{
-		if (add_argc > 1) {
-			e.pop(8, static_cast<uint8_t>(14));
-			e.push_reg(8, static_cast<uint8_t>(14));
-		}
-		e.push_reg(8, static_cast<uint8_t>(operand.register_index()));
-		if (add_argc)
-			e.add(8);
-		add_argc++;
-	}
-	if (add_argc > 1) {
-		e.pop(8, static_cast<uint8_t>(14));
-		e.push_reg(8, static_cast<uint8_t>(14));
+
+	// rip relative, we want to translate the rva from:
+	// [rva relative to current rip] => [rva relative to retaddr]
+	//
+	// + ins.info.length so that we don't have to calc in the vm
+	//
+	if (mem.base == ZYDIS_REGISTER_RIP) {
+		e.lea(8, int32_t(instruction->runtime_address + instruction->info.length + mem.disp.value - retaddr));
+		return;
 	}
-	e.push_imm(8, static_cast<uint64_t>(operand.as_memory().disp.value));
-	e.add(8);
 
-	//e.push_reg(8, uint8_t(operand.register_index()))
-	// .push_imm(8, uint64_t(operand.as_memory().disp.value))
-	// .add(8);
+	auto base = mem.base != ZYDIS_REGISTER_NONE ? uint8_t(operand.register_index()) : ea_none;
+	auto index = mem.index != ZYDIS_REGISTER_NONE ? uint8_t(operand.register_index(true)) : ea_none;
+	auto shift = uint8_t(mem.scale ? std::countr_zero(unsigned(mem.scale)) : 0);
+
+	// fs/gs are the only segments with a base in long mode (tls, the canary, the teb)
+	//
+	if (segment && mem.segment == ZYDIS_REGISTER_FS)
+		shift |= ea_fs;
+	else if (segment && mem.segment == ZYDIS_REGISTER_GS)
+		shift |= ea_gs;
+
+	e.ea(8, base, index, shift, int32_t(mem.disp.value));
 }
 
 void covirt::vm::v0_lifter::push_operand(covirt::zydis_operand& operand, std::optional<int> override_size)
@@ -86,6 +67,245 @@ void covirt::vm::v0_lifter::pop_operand(covirt::zydis_operand& operand, std::opt
 	}
 }
 
+bool covirt::vm::v0_lifter::intrinsic(const std::string& name)
+{
+	static const std::map<std::string, v0_intrinsic> known = {
+		{ "memcpy", v0_intrinsic::memcpy },
+		{ "memmove", v0_intrinsic::memmove },
+		{ "memset", v0_intrinsic::memset },
+		{ "memcmp", v0_intrinsic::memcmp },
+		{ "strlen", v0_intrinsic::strlen },
+	};
+
+	if (!known.contains(name))
+		return false;
+
+	// registers of the first three integer arguments
+	//
+	static constexpr uint8_t sysv[] = { 7, 6, 2 };
+	static constexpr uint8_t ms[] = { 1, 2, 8 };
+	auto args = windows_abi ? ms : sysv;
+
+	e >> e.opcode(v0_op::intrinsic, 1) >> uint8_t(known.at(name)) >> args[0] >> args[1] >> args[2];
+	return true;
+}
+
+void covirt::vm::v0_lifter::push_rmw_operand(covirt::zydis_operand& operand, std::optional<int> override_size)
+{
+	if (!operand.is_memory())
+		return push_operand(operand, override_size);
+
+	push_address(operand);
+	e.dup(8);
+	e.read(override_size.value_or(operand.size));
+}
+
+void covirt::vm::v0_lifter::pop_rmw_operand(covirt::zydis_operand& operand, std::optional<int> override_size)
+{
+	if (!operand.is_memory())
+		return pop_operand(operand, override_size);
+
+	int size = override_size.value_or(operand.size);
+	e.pop(size, static_cast<uint8_t>(tmp_reg_idx));
+	e.write(size, static_cast<uint8_t>(tmp_reg_idx));
+}
+
+bool covirt::vm::v0_lifter::lift_vector(v0_vec_op op)
+{
+	auto& ins = *instruction;
+	bool vex = ins.info.encoding == ZYDIS_INSTRUCTION_ENCODING_VEX;
+
+	if (!vex && ins.info.encoding != ZYDIS_INSTRUCTION_ENCODING_LEGACY)
+		return false;
+
+	// legacy forms are destructive (dst = dst op src), vex forms take two sources
+	//
+	auto visible = ins.info.operand_count_visible;
+	covirt::zydis_operand dst(ins.operands[0]);
+	covirt::zydis_operand src1(ins.operands[vex && visible == 3 ? 1 : 0]);
+	covirt::zydis_operand src2(ins.operands[visible - 1]);
+
+	// vex.128 zeroes the upper half of the destination, which isn't modeled
+	//
+	auto width = dst.is_memory() ? src2.size : dst.size;
+	if (width != (vex ? 32 : 16))
+		return false;
+
+	uint8_t kind = uint8_t(op);
+	int d = 0, s1 = 0, s2 = vec_memory;
+
+	if (dst.is_memory()) {
+		if (op != v0_vec_op::mov)
+			return false;
+
+		kind = uint8_t(v0_vec_op::store);
+		s1 = src2.vector_register_index();
+	}
+	else {
+		d = dst.vector_register_index();
+		s1 = src1.vector_register_index();
+		if (src2.is_register())
+			s2 = src2.vector_register_index();
+	}
+
+	if (d < 0 || s1 < 0 || s2 < 0)
+		return false;
+
+	if (dst.is_memory())
+		push_address(dst);
+	else if (src2.is_memory())
+		push_address(src2);
+
+	e >> e.opcode(v0_op::vec, 1) >> uint8_t(kind | (vex ? vec_ymm : 0)) >> uint8_t(d) >> uint8_t(s1) >> uint8_t(s2);
+	return true;
+}
+
+bool covirt::vm::v0_lifter::lift_string(v0_rep_op op, size_t size)
+{
+	auto& info = instruction->info;
+
+	// `movsd` and `cmpsd` are also sse mnemonics, and only the repeated forms are handled
+	//
+	if (info.meta.category != ZYDIS_CATEGORY_STRINGOP || info.address_width != 64)
+		return false;
+	if (!(info.attributes & (ZYDIS_ATTRIB_HAS_REP | ZYDIS_ATTRIB_HAS_REPE | ZYDIS_ATTRIB_HAS_REPNE)))
+		return false;
+
+	uint8_t kind = uint8_t(op);
+	if (info.attributes & ZYDIS_ATTRIB_HAS_REPNE)
+		kind |= rep_ne;
+
+	e >> e.opcode(v0_op::rep, size) >> kind;
+	return true;
+}
+
+bool covirt::vm::v0_lifter::lift_scalar(v0_fp_op op, size_t width)
+{
+	auto& ins = *instruction;
+
+	// the vex forms take a second source and zero the upper ymm half
+	//
+	if (ins.info.encoding != ZYDIS_INSTRUCTION_ENCODING_LEGACY)
+		return false;
+
+	covirt::zydis_operand dst(ins.operands[0]);
+	covirt::zydis_operand src(ins.operands[1]);
+
+	uint8_t kind = uint8_t(op);
+	int d = 0, s = vec_memory;
+
+	switch (op) {
+	case v0_fp_op::mov:
+		if (dst.is_memory()) {
+			kind = uint8_t(v0_fp_op::store);
+			d = src.vector_register_index();
+		}
+		else {
+			if (src.is_memory())
+				kind = uint8_t(v0_fp_op::load);
+			else
+				s = src.vector_register_index();
+			d = dst.vector_register_index();
+		}
+		break;
+	case v0_fp_op::cvtsi2_32:
+		if (src.size == 8)
+			kind = uint8_t(v0_fp_op::cvtsi2_64);
+		else if (src.size != 4)
+			return false;
+		d = dst.vector_register_index();
+		s = 0;
+		break;
+	case v0_fp_op::cvtt2si_32:
+		if (dst.register_index() < 0 || (dst.size != 4 && dst.size != 8))
+			return false;
+		if (dst.size == 8)
+			kind = uint8_t(v0_fp_op::cvtt2si_64);
+		if (src.is_register())
+			s = src.vector_register_index();
+		break;
+	default:
+		d = dst.vector_register_index();
+		if (src.is_register())
+			s = src.vector_register_index();
+		break;
+	}
+
+	if (d < 0 || s < 0)
+		return false;
+
+	if (kind == uint8_t(v0_fp_op::cvtsi2_32) || kind == uint8_t(v0_fp_op::cvtsi2_64))
+		push_operand(src);
+	else if (dst.is_memory())
+		push_address(dst);
+	else if (src.is_memory())
+		push_address(src);
+
+	e >> e.opcode(v0_op::fp, width) >> kind >> uint8_t(d) >> uint8_t(s);
+
+	// the converted integer is left on the vstack
+	//
+	if (op == v0_fp_op::cvtt2si_32)
+		pop_operand(dst);
+	return true;
+}
+
+bool covirt::vm::v0_lifter::lift_atomic(v0_atomic_op op, covirt::zydis_operand& dst, covirt::zydis_operand& src)
+{
+	// `xchg reg, [mem]` is the same instruction
+	//
+	if (op == v0_atomic_op::xchg && src.is_memory())
+		std::swap(dst, src);
+
+	if (!dst.is_memory())
+		return false;
+
+	switch (op) {
+	case v0_atomic_op::inc:
+	case v0_atomic_op::dec:
+		push_address(dst);
+		e.atomic(dst.size, uint8_t(op));
+		break;
+
+	// leaves the old value, which only has to reach the accumulator on failure.
+	// on success it equals the accumulator, so writing it back is harmless except
+	// for 32 bits, where the pop would clear the upper half of rax
+	//
+	case v0_atomic_op::cmpxchg:
+		if (dst.size == 4)
+			e.push_reg(8, uint8_t(0));
+		push_operand(src);
+		e.push_reg(dst.size, uint8_t(0));
+		push_address(dst);
+		e.atomic(dst.size, uint8_t(op));
+
+		if (dst.size == 4) {
+			e.ext(4, v0_ext_op::zext, 8);
+			e.cmov(8, condition_code(ZYDIS_MNEMONIC_CMOVNZ).value());
+			e.pop(8, uint8_t(0));
+		}
+		else
+			e.pop(dst.size, uint8_t(0));
+		break;
+
+	case v0_atomic_op::xchg:
+	case v0_atomic_op::xadd:
+		push_operand(src);
+		push_address(dst);
+		e.atomic(dst.size, uint8_t(op));
+		pop_operand(src);
+		break;
+
+	default:
+		push_operand(src, dst.size);
+		push_address(dst);
+		e.atomic(dst.size, uint8_t(op));
+		break;
+	}
+
+	return true;
+}
+
 void covirt::vm::v0_vm::initialize(zasm::x86::Assembler& a)
 {
 	for (auto& [name, label] : global_labels)
@@ -102,14 +322,260 @@ void covirt::vm::v0_vm::finalize(zasm::x86::Assembler& a)
 	a.section(".data", zasm::Section::Attribs::Data);
 
 	a.bind(global_labels["vcode"]); a.db(0, code_size);
-	a.bind(global_labels["saved_rsp"]); a.dq(0);
 	a.bind(global_labels["_vsp"]); a.dq(stack_size);
 	a.bind(global_labels["_vip"]); a.dq(0);
 	a.bind(global_labels["vstack"]); a.db(0, stack_size);
 	a.bind(global_labels["retaddr"]); a.dq(0);
+	a.bind(global_labels["vcall_target"]); a.dq(0);
+
+	// v0-v15, the `tmp_reg_idx` scratch slot and rflags
+	//
+	a.bind(global_labels["vcontext"]); a.dq(0, 18);
+
+	a.align(zasm::Align::Type::Data, 16);
+	a.bind(global_labels["vnative_stack"]); a.db(0, native_stack_size);
+	a.bind(global_labels["vnative_stack_top"]);
+
+	// 32 bytes per register so xmm and ymm share rows
+	//
+	a.align(zasm::Align::Type::Data, 32);
+	a.bind(global_labels["vxmm"]); a.db(0, 16 * 32);
+	a.bind(global_labels["vxmm_state"]); a.db(0);
 
+	// xmm0/xmm1 of the guest while `rep` uses them, and its fill pattern
+	//
+	a.bind(global_labels["vrep_scratch"]); a.db(0, 32);
+	a.bind(global_labels["vrep_pattern"]); a.db(0, 32);
+
+	// bit n of entry cc is set if condition cc holds for the flags CF, PF, ZF, SF, OF
+	// packed into bits 0-4 of n
+	//
+	a.bind(global_labels["jcc_table"]);
+	for (int cc = 0; cc < 16; cc++) {
+		uint32_t truth = 0;
+		for (int n = 0; n < 32; n++) {
+			bool cf = n & 1, pf = n & 2, zf = n & 4, sf = n & 8, of = n & 16;
+			bool result = false;
+
+			switch (cc >> 1) {
+			case 0: result = of; break;
+			case 1: result = cf; break;
+			case 2: result = zf; break;
+			case 3: result = cf || zf; break;
+			case 4: result = sf; break;
+			case 5: result = pf; break;
+			case 6: result = sf != of; break;
+			case 7: result = zf || sf != of; break;
+			}
+
+			if (cc & 1)
+				result = !result;
+			truth |= uint32_t(result) << n;
+		}
+		a.dd(truth);
+	}
+
+	// one entry per encodable opcode
+	//
 	a.bind(global_labels["vtable"]);
-	a.dq(0, 8);
+	a.dq(0, 64);
+
+	if (jit_threshold) {
+		auto [descriptors, templates] = assemble_jit_templates();
+
+		a.align(zasm::Align::Type::Data, 8);
+		a.bind(global_labels["vjit_regions"]);
+		for (auto [start, end] : jit_regions) {
+			a.dd(start);
+			a.dd(end);
+			a.dd(0, 2);
+			a.dq(0, 2);
+		}
+
+		std::vector<uint32_t> entries(code_size + 1);
+		for (size_t i = 0; i < jit_regions.size(); i++)
+			if (jit_regions[i].first <= code_size)
+				entries[jit_regions[i].first] = uint32_t(i + 1);
+
+		a.bind(global_labels["vjit_entries"]); a.embed(reinterpret_cast<const uint8_t*>(entries.data()), entries.size() * sizeof(uint32_t));
+
+		a.align(zasm::Align::Type::Data, 8);
+		a.bind(global_labels["vjit_ops"]); a.embed(descriptors.data(), descriptors.size());
+		a.bind(global_labels["vjit_templates"]); a.embed(templates.data(), templates.size());
+
+		// offset of each instruction's translation from the start of its region's,
+		// indexed by bytecode offset
+		//
+		a.align(zasm::Align::Type::Data, 8);
+		a.bind(global_labels["vjit_map"]); a.dd(0, code_size + 1);
+
+		a.bind(global_labels["vjit_cache"]); a.dq(0);
+		a.bind(global_labels["vjit_used"]); a.dq(0);
+		a.bind(global_labels["vjit_seed"]); a.dq(covirt::rand<uint64_t>() | 1);
+	}
+}
+
+void covirt::vm::v0_vm::set_jit(size_t threshold, size_t cache_size, std::vector<uint32_t> entries, size_t code_length)
+{
+	jit_threshold = threshold;
+	jit_cache_size = (cache_size + 0xfff) & ~size_t(0xfff);
+
+	// regions are lifted back to back, each one runs up to the next
+	//
+	std::ranges::sort(entries);
+
+	jit_regions.clear();
+	for (size_t i = 0; i < entries.size(); i++)
+		jit_regions.push_back({ entries[i], i + 1 < entries.size() ? entries[i + 1] : uint32_t(code_length) });
+}
+
+void covirt::vm::v0_vm::create_vtable_once(zasm::x86::Assembler& a)
+{
+	auto pass = a.createLabel();
+
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vtable"]));
+	a.cmp(zasm::x86::qword_ptr(zasm::x86::r9, int32_t(get_encoding(uint8_t(v0_op::vm_enter))) * 8), 0);
+	a.jnz(pass);
+
+	for (auto& [opcode, name] : handler_labels) {
+		if (!is_handler_used(uint8_t(opcode)))
+			continue;
+
+		a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels[name]));
+		a.mov(zasm::x86::qword_ptr(zasm::x86::r9, int32_t(get_encoding(uint8_t(opcode))) * 8), zasm::x86::r10);
+	}
+
+	a.bind(pass);
+}
+
+bool covirt::vm::v0_vm::skip_variant(zasm::x86::Assembler& a, v0_op opcode, int size_bits)
+{
+	if (is_variant_used(uint8_t(opcode), size_bits))
+		return false;
+
+	a.ud2();
+	return true;
+}
+
+// in vreg order, which is the x86 encoding order
+//
+static const std::array<zasm::x86::Gp64, 16> gp_registers = {
+	zasm::x86::rax, zasm::x86::rcx, zasm::x86::rdx, zasm::x86::rbx, zasm::x86::rsp, zasm::x86::rbp, zasm::x86::rsi, zasm::x86::rdi,
+	zasm::x86::r8, zasm::x86::r9, zasm::x86::r10, zasm::x86::r11, zasm::x86::r12, zasm::x86::r13, zasm::x86::r14, zasm::x86::r15
+};
+
+static const std::array<zasm::x86::Xmm, 16> xmm_registers = {
+	zasm::x86::xmm0, zasm::x86::xmm1, zasm::x86::xmm2, zasm::x86::xmm3, zasm::x86::xmm4, zasm::x86::xmm5, zasm::x86::xmm6, zasm::x86::xmm7,
+	zasm::x86::xmm8, zasm::x86::xmm9, zasm::x86::xmm10, zasm::x86::xmm11, zasm::x86::xmm12, zasm::x86::xmm13, zasm::x86::xmm14, zasm::x86::xmm15
+};
+
+static const std::array<zasm::x86::Ymm, 16> ymm_registers = {
+	zasm::x86::ymm0, zasm::x86::ymm1, zasm::x86::ymm2, zasm::x86::ymm3, zasm::x86::ymm4, zasm::x86::ymm5, zasm::x86::ymm6, zasm::x86::ymm7,
+	zasm::x86::ymm8, zasm::x86::ymm9, zasm::x86::ymm10, zasm::x86::ymm11, zasm::x86::ymm12, zasm::x86::ymm13, zasm::x86::ymm14, zasm::x86::ymm15
+};
+
+void covirt::vm::v0_vm::spill_vector_state(zasm::x86::Assembler& a)
+{
+	auto done = a.createLabel();
+	auto full = a.createLabel();
+	auto upper_only = a.createLabel();
+	auto full_done = a.createLabel();
+
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vxmm"]));
+	a.cmp(zasm::x86::byte_ptr(zasm::x86::rip, global_labels["vxmm_state"]), zasm::x86::cl);
+	a.jae(done);
+	a.cmp(zasm::x86::cl, 2);
+	a.je(full);
+
+	for (int i = 0; i < 16; i++)
+		a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r9, i * 32), xmm_registers[i]);
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rip, global_labels["vxmm_state"]), 1);
+	a.jmp(done);
+
+	// the low halves may already be in `vxmm` and modified since, only add the upper ones
+	//
+	a.bind(full);
+	a.cmp(zasm::x86::byte_ptr(zasm::x86::rip, global_labels["vxmm_state"]), 1);
+	a.je(upper_only);
+	for (int i = 0; i < 16; i++)
+		a.vmovdqu(zasm::x86::ymmword_ptr(zasm::x86::r9, i * 32), ymm_registers[i]);
+	a.jmp(full_done);
+
+	a.bind(upper_only);
+	for (int i = 0; i < 16; i++)
+		a.vextractf128(zasm::x86::xmmword_ptr(zasm::x86::r9, i * 32 + 16), ymm_registers[i], 1);
+
+	a.bind(full_done);
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rip, global_labels["vxmm_state"]), 2);
+	a.bind(done);
+}
+
+void covirt::vm::v0_vm::restore_vector_state(zasm::x86::Assembler& a)
+{
+	// nothing can have been spilled
+	//
+	if (!is_handler_used(uint8_t(v0_op::vec)) && !is_handler_used(uint8_t(v0_op::fp)))
+		return;
+
+	auto done = a.createLabel();
+	auto full = a.createLabel();
+	auto clear = a.createLabel();
+
+	a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(zasm::x86::rip, global_labels["vxmm_state"]));
+	a.test(zasm::x86::ecx, zasm::x86::ecx);
+	a.jz(done);
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vxmm"]));
+	a.cmp(zasm::x86::ecx, 2);
+	a.je(full);
+
+	for (int i = 0; i < 16; i++)
+		a.movdqu(xmm_registers[i], zasm::x86::xmmword_ptr(zasm::x86::r9, i * 32));
+	a.jmp(clear);
+
+	a.bind(full);
+	for (int i = 0; i < 16; i++)
+		a.vmovdqu(ymm_registers[i], zasm::x86::ymmword_ptr(zasm::x86::r9, i * 32));
+
+	a.bind(clear);
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rip, global_labels["vxmm_state"]), 0);
+	a.bind(done);
+}
+
+void covirt::vm::v0_vm::emit_string_instruction(zasm::x86::Assembler& a, v0_rep_op op, bool ne, int size_bits)
+{
+	static constexpr uint8_t opcodes[] = { 0xa4, 0xaa, 0xa6, 0xae };
+
+	if (size_bits == 0b01)
+		a.db(0x66);
+	a.db(ne ? 0xf2 : 0xf3);
+	if (size_bits == 0b11)
+		a.db(0x48); // rex.w
+	a.db(uint8_t(opcodes[int(op)] + (size_bits != 0b00)));
+}
+
+void covirt::vm::v0_vm::emit_locked_instruction(zasm::x86::Assembler& a, v0_atomic_op op, int size_bits)
+{
+	// byte forms, the wider ones are the next opcode
+	//
+	static constexpr uint8_t opcodes[] = { 0x86, 0xc0, 0xb0, 0x00, 0x28, 0x20, 0x08, 0x30, 0xfe, 0xfe };
+
+	bool escaped = op == v0_atomic_op::xadd || op == v0_atomic_op::cmpxchg;
+	bool unary = op == v0_atomic_op::inc || op == v0_atomic_op::dec;
+
+	// xchg with a memory operand is always locked
+	//
+	if (op != v0_atomic_op::xchg)
+		a.db(0xf0);
+	if (size_bits == 0b01)
+		a.db(0x66);
+	a.db(uint8_t(0x41 | (size_bits == 0b11 ? 0x08 : 0) | (unary ? 0 : 0x04))); // rex: w, r = r11, b = r10
+	if (escaped)
+		a.db(0x0f);
+	a.db(uint8_t(opcodes[int(op)] + (size_bits != 0b00)));
+
+	// modrm: [r10] with r11 or the /0 (inc), /1 (dec) extension
+	//
+	a.db(uint8_t((unary ? int(op == v0_atomic_op::dec) : 3) << 3 | 2));
 }
 
 void covirt::vm::v0_vm::vm_next_instruction(zasm::x86::Assembler& a, std::optional<zasm::Label> label)
@@ -117,19 +583,115 @@ void covirt::vm::v0_vm::vm_next_instruction(zasm::x86::Assembler& a, std::option
 	if (label.has_value())
 		a.bind(label.value());
 
+	if (!replicates_dispatch()) {
+		a.jmp(global_labels["vdispatch"]);
+		return;
+	}
+
 	a.movzx(zasm::x86::rcx, zasm::x86::byte_ptr(vip));
 	a.and_(zasm::x86::cl, 0b00111111);
 	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vtable"]));
 	a.jmp(zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rcx, 8));
 }
 
-void covirt::vm::v0_vm::jump_using_table(zasm::x86::Assembler& a, zasm::Label& paths)
+void covirt::vm::v0_vm::test_condition(zasm::x86::Assembler& a, std::optional<zasm::x86::Gp64> table)
+{
+	// CF (bit 0) stays, PF (bit 2) -> 1, ZF/SF (bits 6, 7) -> 2, 3, OF (bit 11) -> 4
+	//
+	a.mov(zasm::x86::r9d, zasm::x86::edx);
+	a.and_(zasm::x86::r9d, 0x1);
+	a.mov(zasm::x86::r10d, zasm::x86::edx);
+	a.shr(zasm::x86::r10d, 1);
+	a.and_(zasm::x86::r10d, 0x2);
+	a.or_(zasm::x86::r9d, zasm::x86::r10d);
+	a.mov(zasm::x86::r10d, zasm::x86::edx);
+	a.shr(zasm::x86::r10d, 4);
+	a.and_(zasm::x86::r10d, 0xc);
+	a.or_(zasm::x86::r9d, zasm::x86::r10d);
+	a.shr(zasm::x86::edx, 7);
+	a.and_(zasm::x86::edx, 0x10);
+	a.or_(zasm::x86::r9d, zasm::x86::edx);
+
+	if (table.has_value()) {
+		a.mov(zasm::x86::r10d, zasm::x86::dword_ptr(table.value(), zasm::x86::rcx, 4));
+	}
+	else {
+		a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["jcc_table"]));
+		a.mov(zasm::x86::r10d, zasm::x86::dword_ptr(zasm::x86::r10, zasm::x86::rcx, 4));
+	}
+	a.bt(zasm::x86::r10d, zasm::x86::r9d);
+}
+
+void covirt::vm::v0_vm::load_vflags(zasm::x86::Assembler& a)
+{
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+	a.movzx(zasm::x86::edx, zasm::x86::word_ptr(zasm::x86::r9, vflags_offset));
+}
+
+void covirt::vm::v0_vm::store_vflags(zasm::x86::Assembler& a, zasm::x86::Gp64 flags, uint32_t mask)
+{
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+	a.and_(flags, mask);
+	a.and_(zasm::x86::qword_ptr(zasm::x86::r9, vflags_offset), int32_t(~mask));
+	a.or_(zasm::x86::qword_ptr(zasm::x86::r9, vflags_offset), flags);
+}
+
+void covirt::vm::v0_vm::save_context(zasm::x86::Assembler& a)
+{
+	// mov and lea leave the flags alone until pushfq
+	//
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]), zasm::x86::rax);
+	a.lea(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+	for (int i = 1; i < 16; i++)
+		a.mov(zasm::x86::qword_ptr(zasm::x86::rax, i * 8), gp_registers[i]);
+
+	a.lea(zasm::x86::rsp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vnative_stack_top"]));
+	a.pushfq();
+	a.pop(zasm::x86::qword_ptr(zasm::x86::rax, vflags_offset));
+}
+
+void covirt::vm::v0_vm::load_context(zasm::x86::Assembler& a)
+{
+	a.lea(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+	a.push(zasm::x86::qword_ptr(zasm::x86::rax, vflags_offset));
+	a.popfq();
+	for (int i = 1; i < 16; i++)
+		a.mov(gp_registers[i], zasm::x86::qword_ptr(zasm::x86::rax, i * 8));
+	a.mov(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::rax));
+}
+
+void covirt::vm::v0_vm::exit_vm(zasm::x86::Assembler& a)
+{
+	restore_vector_state(a);
+	load_context(a);
+
+	vm_enter_emitter.revert_effects(a);
+
+	a.jmp(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]));
+}
+
+void covirt::vm::v0_vm::jump_using_table(zasm::x86::Assembler& a, zasm::Label& paths, size_t count)
 {
 	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, paths));
 	a.jmp(zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rcx, 8));
 
 	a.bind(paths);
-	a.dq(0, 4);
+	a.dq(0, count);
+}
+
+zasm::x86::Mem covirt::vm::v0_vm::stack_slot(int size_bits, int32_t disp)
+{
+	return stack_slot(size_bits, vsp, disp);
+}
+
+zasm::x86::Mem covirt::vm::v0_vm::stack_slot(int size_bits, zasm::x86::Gp64 base, int32_t disp)
+{
+	switch (size_bits) {
+	case 0b00: return zasm::x86::byte_ptr(base, disp);
+	case 0b01: return zasm::x86::word_ptr(base, disp);
+	case 0b10: return zasm::x86::dword_ptr(base, disp);
+	default: return zasm::x86::qword_ptr(base, disp);
+	}
 }
 
 void covirt::vm::v0_vm::get_size_from_opcode(zasm::x86::Assembler& a, zasm::Label& start)
@@ -142,8 +704,7 @@ void covirt::vm::v0_vm::get_size_from_opcode(zasm::x86::Assembler& a, zasm::Labe
 
 void covirt::vm::v0_vm::get_vreg_address(zasm::x86::Assembler& a)
 {
-	a.mov(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["saved_rsp"]));
-	a.sub(zasm::x86::r9, 16 * 8);
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
 	a.movzx(zasm::x86::r10, zasm::x86::byte_ptr(vip));
 	a.lea(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::r10, 8));
 	a.add(vip, 1);
@@ -151,13 +712,738 @@ void covirt::vm::v0_vm::get_vreg_address(zasm::x86::Assembler& a)
 
 void covirt::vm::v0_vm::get_vreg_value(zasm::x86::Assembler& a)
 {
-	a.mov(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["saved_rsp"]));
-	a.sub(zasm::x86::r9, 16 * 8);
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
 	a.movzx(zasm::x86::r10, zasm::x86::byte_ptr(vip));
 	a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::r10, 8));
 	a.add(vip, 1);
 }
 
+void covirt::vm::v0_vm::pin_jit_registers(zasm::x86::Assembler& a)
+{
+	a.lea(zasm::x86::rbx, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+	a.lea(zasm::x86::r12, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["jcc_table"]));
+	a.lea(zasm::x86::r13, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vtable"]));
+	a.lea(zasm::x86::r14, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
+}
+
+void covirt::vm::v0_vm::enter_jit(zasm::x86::Assembler& a)
+{
+	auto run = a.createLabel();
+	auto interpret = a.createLabel();
+
+	// `vjit_entries` holds the region number + 1 at each region's entry offset,
+	// 0 everywhere else (re-entries after a call or a native instruction)
+	//
+	a.mov(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::rip, global_labels["_vip"]));
+	a.cmp(zasm::x86::ecx, int32_t(code_size));
+	a.ja(interpret);
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_entries"]));
+	a.mov(zasm::x86::edx, zasm::x86::dword_ptr(zasm::x86::r9, zasm::x86::rcx, 4));
+	a.test(zasm::x86::edx, zasm::x86::edx);
+	a.jz(interpret);
+	a.imul(zasm::x86::edx, zasm::x86::edx, int32_t(jit_region_size));
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_regions"]));
+	a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rdx, 1, -int32_t(jit_region_size)));
+
+	// a region whose translation failed (or got flushed) starts counting again
+	//
+	a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r9, 16));
+	a.test(zasm::x86::r10, zasm::x86::r10);
+	a.jnz(run);
+	a.add(zasm::x86::dword_ptr(zasm::x86::r9, 8), 1);
+	a.cmp(zasm::x86::dword_ptr(zasm::x86::r9, 8), int32_t(jit_threshold));
+	a.jb(interpret);
+	a.mov(zasm::x86::dword_ptr(zasm::x86::r9, 8), 0);
+	a.call(global_labels["vjit_compile"]);
+	a.test(zasm::x86::r10, zasm::x86::r10);
+	a.jz(interpret);
+
+	a.bind(run);
+	pin_jit_registers(a);
+	a.jmp(zasm::x86::r10);
+
+	a.bind(interpret);
+}
+
+void covirt::vm::v0_vm::emit_unobfuscated(zasm::x86::Assembler& a)
+{
+	if (jit_threshold)
+		emit_jit_compiler(a);
+}
+
+void covirt::vm::v0_vm::emit_jit_compiler(zasm::x86::Assembler& a)
+{
+	auto cache_size = int32_t(jit_cache_size);
+
+	// frame: region code start, current chunk, hole index, region code size, then
+	// the pushed region, vsp and vip
+	//
+	constexpr int32_t base = 0x00, chunk = 0x08, hole = 0x10, size = 0x18, region = 0x20;
+
+	// xorshift64 on `vjit_seed` into r10, clobbers rsi
+	//
+	auto random = [&]() {
+		a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_seed"]));
+		a.mov(zasm::x86::rsi, zasm::x86::r10);
+		a.shl(zasm::x86::rsi, 13);
+		a.xor_(zasm::x86::r10, zasm::x86::rsi);
+		a.mov(zasm::x86::rsi, zasm::x86::r10);
+		a.shr(zasm::x86::rsi, 7);
+		a.xor_(zasm::x86::r10, zasm::x86::rsi);
+		a.mov(zasm::x86::rsi, zasm::x86::r10);
+		a.shl(zasm::x86::rsi, 17);
+		a.xor_(zasm::x86::r10, zasm::x86::rsi);
+		a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_seed"]), zasm::x86::r10);
+	};
+
+	// r9 = descriptor of the instruction at vcode (rbp) + ip (rcx)
+	//
+	auto descriptor = [&]() {
+		a.movzx(zasm::x86::r9d, zasm::x86::byte_ptr(zasm::x86::rbp, zasm::x86::rcx));
+		a.shl(zasm::x86::r9d, 4);
+		a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_ops"]));
+		a.add(zasm::x86::r9, zasm::x86::r10);
+	};
+
+	// r10 = length of that instruction, clobbers rsi
+	//
+	auto length = [&]() {
+		auto no_byte = a.createLabel();
+		auto no_word = a.createLabel();
+
+		a.movzx(zasm::x86::r10d, zasm::x86::byte_ptr(zasm::x86::r9, 4));
+		a.test(zasm::x86::byte_ptr(zasm::x86::r9, 3), jit_byte_length);
+		a.jz(no_byte);
+		a.movzx(zasm::x86::esi, zasm::x86::byte_ptr(zasm::x86::rbp, zasm::x86::rcx, 1, 1));
+		a.add(zasm::x86::r10d, zasm::x86::esi);
+		a.bind(no_byte);
+		a.test(zasm::x86::byte_ptr(zasm::x86::r9, 3), jit_word_length);
+		a.jz(no_word);
+		a.movzx(zasm::x86::esi, zasm::x86::word_ptr(zasm::x86::rbp, zasm::x86::rcx, 1, 1));
+		a.add(zasm::x86::esi, zasm::x86::esi);
+		a.add(zasm::x86::r10d, zasm::x86::esi);
+		a.bind(no_word);
+	};
+
+	// copies edx bytes from rsi to rax, advancing both
+	//
+	auto copy = [&]() {
+		auto loop = a.createLabel();
+		auto done = a.createLabel();
+
+		a.bind(loop);
+		a.test(zasm::x86::edx, zasm::x86::edx);
+		a.jz(done);
+		a.mov(zasm::x86::r10b, zasm::x86::byte_ptr(zasm::x86::rsi));
+		a.mov(zasm::x86::byte_ptr(zasm::x86::rax), zasm::x86::r10b);
+		a.add(zasm::x86::rsi, 1);
+		a.add(zasm::x86::rax, 1);
+		a.sub(zasm::x86::edx, 1);
+		a.jmp(loop);
+		a.bind(done);
+	};
+
+	// mprotect(cache, size, prot), the result is left in rax
+	//
+	auto protect = [&](int32_t prot) {
+		a.push(cache_size);
+		a.pop(zasm::x86::rsi);
+		a.push(prot);
+		a.pop(zasm::x86::rdx);
+		a.mov(zasm::x86::rdi, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_cache"]));
+		a.push(10);
+		a.pop(zasm::x86::rax);
+		a.syscall();
+	};
+
+	auto mapped = a.createLabel();
+	auto layout = a.createLabel();
+	auto no_stub_space = a.createLabel();
+	auto laid_out = a.createLabel();
+	auto flush = a.createLabel();
+	auto fits = a.createLabel();
+	auto emit = a.createLabel();
+	auto junk_jump = a.createLabel();
+	auto junk = a.createLabel();
+	auto padded = a.createLabel();
+	auto patch = a.createLabel();
+	auto next_hole = a.createLabel();
+	auto patched = a.createLabel();
+	auto no_stub = a.createLabel();
+	auto emitted = a.createLabel();
+	auto fail = a.createLabel();
+	auto done = a.createLabel();
+
+	std::array<zasm::Label, 8> kinds;
+	for (auto& label : kinds)
+		label = a.createLabel();
+
+	a.bind(global_labels["vjit_compile"]);
+	a.push(vip);
+	a.push(vsp);
+	a.push(zasm::x86::r9);
+	a.sub(zasm::x86::rsp, 0x20);
+
+	a.rdtsc();
+	a.shl(zasm::x86::rdx, 32);
+	a.or_(zasm::x86::rax, zasm::x86::rdx);
+	a.xor_(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_seed"]), zasm::x86::rax);
+	a.or_(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_seed"]), 1);
+
+	// mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+	// the first time anything gets translated
+	//
+	a.cmp(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_cache"]), 0);
+	a.jne(mapped);
+	a.push(cache_size);
+	a.pop(zasm::x86::rsi);
+	a.push(3);
+	a.pop(zasm::x86::rdx);
+	a.push(0x22);
+	a.pop(zasm::x86::r10);
+	a.push(-1);
+	a.pop(zasm::x86::r8);
+	a.push(0);
+	a.pop(zasm::x86::r9);
+	a.push(0);
+	a.pop(zasm::x86::rdi);
+	a.push(9);
+	a.pop(zasm::x86::rax);
+	a.syscall();
+	a.cmp(zasm::x86::rax, -4096);
+	a.ja(fail);
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_cache"]), zasm::x86::rax);
+	a.bind(mapped);
+
+	// first pass: where every instruction's translation goes, after 0-7 bytes of
+	// padding; eax is the running offset
+	//
+	a.mov(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rsp, region));
+	a.mov(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::r9));
+	a.lea(zasm::x86::rbp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
+	a.lea(zasm::x86::r11, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_map"]));
+	a.xor_(zasm::x86::eax, zasm::x86::eax);
+
+	a.bind(layout);
+	a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rsp, region));
+	a.cmp(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::r10, 4));
+	a.jae(laid_out);
+	random();
+	a.and_(zasm::x86::r10d, 7);
+	a.add(zasm::x86::eax, zasm::x86::r10d);
+	a.mov(zasm::x86::dword_ptr(zasm::x86::r11, zasm::x86::rcx, 4), zasm::x86::eax);
+	descriptor();
+	a.movzx(zasm::x86::r10d, zasm::x86::byte_ptr(zasm::x86::r9, 2));
+	a.add(zasm::x86::eax, zasm::x86::r10d);
+	length();
+	a.test(zasm::x86::byte_ptr(zasm::x86::r9, 3), jit_callout);
+	a.jz(no_stub_space);
+	a.add(zasm::x86::eax, zasm::x86::r10d);
+	a.add(zasm::x86::eax, 1);
+	a.bind(no_stub_space);
+	a.add(zasm::x86::ecx, zasm::x86::r10d);
+	a.jmp(layout);
+
+	a.bind(laid_out);
+	a.add(zasm::x86::eax, 15);
+	a.and_(zasm::x86::eax, -16);
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rsp, size), zasm::x86::rax);
+
+	// the eviction policy: when the region doesn't fit behind the translations
+	// already there, all of them are dropped and have to get hot again
+	//
+	a.cmp(zasm::x86::rax, cache_size);
+	a.ja(fail);
+	a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_used"]));
+	a.add(zasm::x86::r10, zasm::x86::rax);
+	a.cmp(zasm::x86::r10, cache_size);
+	a.jbe(fits);
+	a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_regions"]));
+	a.mov(zasm::x86::ecx, int32_t(jit_regions.size()));
+	a.bind(flush);
+	a.mov(zasm::x86::qword_ptr(zasm::x86::r10, 16), 0);
+	a.add(zasm::x86::r10, jit_region_size);
+	a.sub(zasm::x86::ecx, 1);
+	a.test(zasm::x86::ecx, zasm::x86::ecx);
+	a.jnz(flush);
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_used"]), 0);
+	a.bind(fits);
+
+	protect(3);
+	a.cmp(zasm::x86::rax, -4096);
+	a.ja(fail);
+
+	a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_cache"]));
+	a.add(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_used"]));
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rsp, base), zasm::x86::r10);
+
+	// second pass: padding, the template with its holes patched, and for callouts
+	// a copy of the instruction plus `jit_resume` for the handler to run into
+	//
+	a.mov(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rsp, region));
+	a.mov(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::r9));
+	a.lea(zasm::x86::rbp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
+	a.lea(zasm::x86::r11, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_map"]));
+	a.mov(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::rsp, base));
+
+	a.bind(emit);
+	a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rsp, region));
+	a.cmp(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::r10, 4));
+	a.jae(emitted);
+	a.mov(zasm::x86::r10d, zasm::x86::dword_ptr(zasm::x86::r11, zasm::x86::rcx, 4));
+	a.add(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rsp, base));
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rsp, chunk), zasm::x86::r10);
+
+	// a nop, or a short jmp over random bytes
+	//
+	a.sub(zasm::x86::r10, zasm::x86::rax);
+	a.cmp(zasm::x86::r10, 1);
+	a.jb(padded);
+	a.jne(junk_jump);
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rax), zasm::Imm8(0x90));
+	a.add(zasm::x86::rax, 1);
+	a.jmp(padded);
+	a.bind(junk_jump);
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rax), zasm::Imm8(0xeb));
+	a.sub(zasm::x86::r10d, 2);
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rax, 1), zasm::x86::r10b);
+	a.add(zasm::x86::rax, 2);
+	a.bind(junk);
+	a.cmp(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::rsp, chunk));
+	a.jae(padded);
+	random();
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rax), zasm::x86::r10b);
+	a.add(zasm::x86::rax, 1);
+	a.jmp(junk);
+	a.bind(padded);
+
+	descriptor();
+	a.movzx(zasm::x86::esi, zasm::x86::word_ptr(zasm::x86::r9));
+	a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_templates"]));
+	a.add(zasm::x86::rsi, zasm::x86::r10);
+	a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(zasm::x86::r9, 2));
+	copy();
+
+	// rsi = where the hole is, rdx = the operand it's filled from
+	//
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rsp, hole), 0);
+	a.bind(patch);
+	a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rsp, hole));
+	a.cmp(zasm::x86::r10, 4);
+	a.jae(patched);
+	a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(zasm::x86::r9, zasm::x86::r10, 2, 7));
+	a.test(zasm::x86::edx, zasm::x86::edx);
+	a.jz(patched);
+	a.movzx(zasm::x86::esi, zasm::x86::byte_ptr(zasm::x86::r9, zasm::x86::r10, 2, 6));
+	a.add(zasm::x86::rsi, zasm::x86::qword_ptr(zasm::x86::rsp, chunk));
+	a.mov(zasm::x86::r10d, zasm::x86::edx);
+	a.shr(zasm::x86::r10d, 4);
+	a.and_(zasm::x86::edx, 15);
+	a.add(zasm::x86::rdx, zasm::x86::rcx);
+	a.add(zasm::x86::rdx, zasm::x86::rbp);
+	for (int kind = int(v0_jit_hole::copy1); kind <= int(v0_jit_hole::ip); kind++) {
+		a.cmp(zasm::x86::r10d, kind);
+		a.je(kinds[kind]);
+	}
+	a.jmp(next_hole);
+
+	a.bind(kinds[int(v0_jit_hole::copy1)]);
+	a.mov(zasm::x86::r10b, zasm::x86::byte_ptr(zasm::x86::rdx));
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rsi), zasm::x86::r10b);
+	a.jmp(next_hole);
+
+	a.bind(kinds[int(v0_jit_hole::copy2)]);
+	a.mov(zasm::x86::r10w, zasm::x86::word_ptr(zasm::x86::rdx));
+	a.mov(zasm::x86::word_ptr(zasm::x86::rsi), zasm::x86::r10w);
+	a.jmp(next_hole);
+
+	a.bind(kinds[int(v0_jit_hole::copy4)]);
+	a.mov(zasm::x86::r10d, zasm::x86::dword_ptr(zasm::x86::rdx));
+	a.mov(zasm::x86::dword_ptr(zasm::x86::rsi), zasm::x86::r10d);
+	a.jmp(next_hole);
+
+	a.bind(kinds[int(v0_jit_hole::copy8)]);
+	a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rdx));
+	a.mov(zasm::x86::qword_ptr(zasm::x86::rsi), zasm::x86::r10);
+	a.jmp(next_hole);
+
+	a.bind(kinds[int(v0_jit_hole::vreg)]);
+	a.movzx(zasm::x86::r10d, zasm::x86::byte_ptr(zasm::x86::rdx));
+	a.shl(zasm::x86::r10d, 3);
+	a.mov(zasm::x86::dword_ptr(zasm::x86::rsi), zasm::x86::r10d);
+	a.jmp(next_hole);
+
+	// rel32 from the end of the hole to the target's translation
+	//
+	a.bind(kinds[int(v0_jit_hole::branch)]);
+	a.movzx(zasm::x86::r10d, zasm::x86::word_ptr(zasm::x86::rdx));
+	a.mov(zasm::x86::r10d, zasm::x86::dword_ptr(zasm::x86::r11, zasm::x86::r10, 4));
+	a.add(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rsp, base));
+	a.sub(zasm::x86::r10, zasm::x86::rsi);
+	a.sub(zasm::x86::r10, 4);
+	a.mov(zasm::x86::dword_ptr(zasm::x86::rsi), zasm::x86::r10d);
+	a.jmp(next_hole);
+
+	a.bind(kinds[int(v0_jit_hole::ip)]);
+	a.mov(zasm::x86::dword_ptr(zasm::x86::rsi), zasm::x86::ecx);
+
+	a.bind(next_hole);
+	a.add(zasm::x86::qword_ptr(zasm::x86::rsp, hole), 1);
+	a.jmp(patch);
+	a.bind(patched);
+
+	a.test(zasm::x86::byte_ptr(zasm::x86::r9, 3), jit_callout);
+	a.jz(no_stub);
+	length();
+	a.mov(zasm::x86::edx, zasm::x86::r10d);
+	a.lea(zasm::x86::rsi, zasm::x86::qword_ptr(zasm::x86::rbp, zasm::x86::rcx));
+	copy();
+	a.mov(zasm::x86::byte_ptr(zasm::x86::rax), zasm::Imm8(get_encoding(uint8_t(v0_op::jit_resume))));
+	a.add(zasm::x86::rax, 1);
+	a.bind(no_stub);
+
+	length();
+	a.add(zasm::x86::ecx, zasm::x86::r10d);
+	a.jmp(emit);
+
+	a.bind(emitted);
+	protect(5);
+	a.cmp(zasm::x86::rax, -4096);
+	a.ja(fail);
+
+	a.mov(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rsp, region));
+	a.mov(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::r9));
+	a.lea(zasm::x86::r11, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_map"]));
+	a.mov(zasm::x86::r10d, zasm::x86::dword_ptr(zasm::x86::r11, zasm::x86::rcx, 4));
+	a.add(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rsp, base));
+	a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 16), zasm::x86::r10);
+	a.mov(zasm::x86::rcx, zasm::x86::qword_ptr(zasm::x86::rsp, size));
+	a.add(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vjit_used"]), zasm::x86::rcx);
+	a.jmp(done);
+
+	a.bind(fail);
+	a.xor_(zasm::x86::r10d, zasm::x86::r10d);
+
+	a.bind(done);
+	a.add(zasm::x86::rsp, 0x20);
+	a.pop(zasm::x86::r9);
+	a.pop(vsp);
+	a.pop(vip);
+	a.ret();
+}
+
+// fixed part of each instruction's encoding, opcode included
+//
+static uint8_t jit_instruction_length(covirt::vm::v0_op op, int size_bits)
+{
+	using enum covirt::vm::v0_op;
+
+	switch (op) {
+	case push_imm: return uint8_t(1 + (1 << size_bits));
+	case call: case vm_exit: return size_bits == 0b11 ? 1 : 5;
+	case ea: return 8;
+	case lea: case vec: case intrinsic: return 5;
+	case jcc: case fp: return 4;
+	case jmp: case ret: case jmp_table: return 3;
+	case push_reg: case pop: case write: case execute_native: case rep: case shift: case mul:
+	case setcc: case cmov: case ext: case atomic: case bitop: case arith: return 2;
+	default: return 1;
+	}
+}
+
+std::pair<std::vector<uint8_t>, std::vector<uint8_t>> covirt::vm::v0_vm::assemble_jit_templates()
+{
+	static const std::array<zasm::x86::Gp, 4> c = { zasm::x86::cl, zasm::x86::cx, zasm::x86::ecx, zasm::x86::rcx };
+	static const std::array<zasm::x86::Gp, 4> d = { zasm::x86::dl, zasm::x86::dx, zasm::x86::edx, zasm::x86::rdx };
+
+	// forces the disp32 form, its bytes are the hole
+	//
+	constexpr int32_t placeholder = 0x7fffff00;
+
+	struct jit_template {
+		uint16_t offset;
+		uint8_t length;
+		std::vector<std::pair<uint8_t, uint8_t>> holes;
+	};
+
+	std::vector<uint8_t> descriptors(256 * jit_descriptor_size, 0);
+	std::vector<uint8_t> blob;
+
+	// a hole is marked right after the instruction it ends, all of them are the
+	// last field of their instruction
+	//
+	auto build = [&](auto&& body) {
+		zasm::Program program(zasm::MachineMode::AMD64);
+		zasm::x86::Assembler t(program);
+		zasm::Serializer serializer{};
+
+		std::vector<std::tuple<zasm::Label, int, v0_jit_hole, int>> marks;
+		auto mark = [&](int width, v0_jit_hole kind, int operand) {
+			auto label = t.createLabel();
+			t.bind(label);
+			marks.push_back({ label, width, kind, operand });
+		};
+
+		body(t, mark);
+
+		const auto res = serializer.serialize(program, 0);
+		out::assertion(res == zasm::ErrorCode::None, "failed to serialize jit template: {}:{}", res.getErrorName(), res.getErrorMessage());
+		out::assertion(serializer.getCodeSize() < 256 && marks.size() <= 4 && blob.size() < 0x10000, "jit template doesn't fit its descriptor");
+
+		jit_template result = { uint16_t(blob.size()), uint8_t(serializer.getCodeSize()) };
+		for (auto& [label, width, kind, operand] : marks)
+			result.holes.push_back({ uint8_t(serializer.getLabelAddress(label.getId()) - width), uint8_t(uint8_t(kind) << 4 | operand) });
+
+		blob.insert(blob.end(), serializer.getCode(), serializer.getCode() + serializer.getCodeSize());
+		return result;
+	};
+
+	auto describe = [&](uint8_t raw, const jit_template& t, uint8_t flags, uint8_t length) {
+		auto entry = &descriptors[raw * jit_descriptor_size];
+		*(uint16_t*)&entry[0] = t.offset;
+		entry[2] = t.length;
+		entry[3] = flags;
+		entry[4] = length;
+		for (size_t i = 0; i < t.holes.size(); i++) {
+			entry[6 + i * 2] = t.holes[i].first;
+			entry[7 + i * 2] = t.holes[i].second;
+		}
+	};
+
+	// control flow the translation can't follow (calls may enter the vm again and
+	// flush the cache under it) goes back to the interpreter for good
+	//
+	auto leave = build([&](zasm::x86::Assembler& a, auto& mark) {
+		a.lea(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::r14, placeholder));
+		mark(4, v0_jit_hole::ip, 0);
+		a.movzx(zasm::x86::rcx, zasm::x86::byte_ptr(zasm::x86::rax));
+		a.and_(zasm::x86::cl, 0b00111111);
+		a.jmp(zasm::x86::qword_ptr(zasm::x86::r13, zasm::x86::rcx, 8));
+	});
+
+	// everything else without a template runs its handler on a copy placed right
+	// behind this, which dispatches into `jit_resume`
+	//
+	auto callout = build([&](zasm::x86::Assembler& a, auto& mark) {
+		auto stub = a.createLabel();
+		a.lea(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::rip, stub));
+		a.movzx(zasm::x86::rcx, zasm::x86::byte_ptr(zasm::x86::rax));
+		a.and_(zasm::x86::cl, 0b00111111);
+		a.jmp(zasm::x86::qword_ptr(zasm::x86::r13, zasm::x86::rcx, 8));
+		a.bind(stub);
+	});
+
+	auto jmp = build([&](zasm::x86::Assembler& a, auto& mark) {
+		a.db(0xe9);
+		a.dd(0);
+		mark(4, v0_jit_hole::branch, 1);
+	});
+
+	auto jcc = build([&](zasm::x86::Assembler& a, auto& mark) {
+		a.movzx(zasm::x86::edx, zasm::x86::word_ptr(zasm::x86::rbx, vflags_offset));
+		a.mov(zasm::x86::ecx, 0);
+		mark(4, v0_jit_hole::copy1, 1);
+		test_condition(a, zasm::x86::r12);
+
+		// jc rel32
+		//
+		a.db(0x0f);
+		a.db(0x82);
+		a.dd(0);
+		mark(4, v0_jit_hole::branch, 2);
+	});
+
+	auto ea = build([&](zasm::x86::Assembler& a, auto& mark) {
+		auto no_base = a.createLabel();
+		auto no_index = a.createLabel();
+		auto no_fs = a.createLabel();
+		auto no_gs = a.createLabel();
+
+		// mov rdx, simm32 (the displacement)
+		//
+		a.db(0x48);
+		a.db(0xc7);
+		a.db(0xc2);
+		a.dd(0);
+		mark(4, v0_jit_hole::copy4, 4);
+
+		a.mov(zasm::x86::r11d, 0);
+		mark(4, v0_jit_hole::copy1, 3);
+
+		a.mov(zasm::x86::ecx, 0);
+		mark(4, v0_jit_hole::copy1, 1);
+		a.cmp(zasm::x86::ecx, ea_none);
+		a.je(no_base);
+		a.add(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::rbx, zasm::x86::rcx, 8));
+		a.bind(no_base);
+
+		a.mov(zasm::x86::ecx, 0);
+		mark(4, v0_jit_hole::copy1, 2);
+		a.cmp(zasm::x86::ecx, ea_none);
+		a.je(no_index);
+		a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rbx, zasm::x86::rcx, 8));
+		a.mov(zasm::x86::ecx, zasm::x86::r11d);
+		a.and_(zasm::x86::ecx, 3);
+		a.shl(zasm::x86::r10, zasm::x86::cl);
+		a.add(zasm::x86::rdx, zasm::x86::r10);
+		a.bind(no_index);
+
+		a.test(zasm::x86::r11d, ea_fs);
+		a.jz(no_fs);
+		a.rdfsbase(zasm::x86::r10);
+		a.add(zasm::x86::rdx, zasm::x86::r10);
+		a.bind(no_fs);
+		a.test(zasm::x86::r11d, ea_gs);
+		a.jz(no_gs);
+		a.rdgsbase(zasm::x86::r10);
+		a.add(zasm::x86::rdx, zasm::x86::r10);
+		a.bind(no_gs);
+
+		a.sub(vsp, 8);
+		a.mov(zasm::x86::qword_ptr(vsp), zasm::x86::rdx);
+	});
+
+	// unknown encodings never show up in the bytecode, but shouldn't hang the translator
+	//
+	for (int raw = 0; raw < 256; raw++)
+		describe(uint8_t(raw), leave, 0, 1);
+
+	for (int op = 0; op <= int(v0_op::jit_resume); op++) {
+		for (int bits = 0; bits < 4; bits++) {
+			auto raw = uint8_t(get_encoding(uint8_t(op)) | bits << 6);
+			auto length = jit_instruction_length(v0_op(op), bits);
+			auto s = 1 << bits;
+
+			// the templates mirror their handler's size variant with the operands baked in
+			//
+			auto arith = [&](auto&& apply) {
+				return build([&](zasm::x86::Assembler& a, auto& mark) {
+					a.mov(c[bits], stack_slot(bits, vsp));
+					a.add(vsp, s);
+					a.mov(d[bits], stack_slot(bits, vsp));
+					apply(a);
+				});
+			};
+
+			auto compare = [&](auto&& apply) {
+				return arith([&](zasm::x86::Assembler& a) {
+					apply(a);
+					a.pushfq();
+					a.pop(zasm::x86::r11);
+					a.add(vsp, s);
+					a.and_(zasm::x86::r11, arith_flags);
+					a.and_(zasm::x86::qword_ptr(zasm::x86::rbx, vflags_offset), int32_t(~arith_flags));
+					a.or_(zasm::x86::qword_ptr(zasm::x86::rbx, vflags_offset), zasm::x86::r11);
+				});
+			};
+
+			switch (v0_op(op)) {
+			case v0_op::push_imm:
+				describe(raw, build([&](zasm::x86::Assembler& a, auto& mark) {
+					if (bits == 0b11) {
+						a.mov(zasm::x86::rcx, int64_t(0x7fffffffffffffff));
+						mark(8, v0_jit_hole::copy8, 1);
+						a.sub(vsp, 8);
+						a.mov(zasm::x86::qword_ptr(vsp), zasm::x86::rcx);
+						return;
+					}
+					a.sub(vsp, s);
+					a.mov(stack_slot(bits, vsp), 0);
+					mark(s, v0_jit_hole(int(v0_jit_hole::copy1) + bits), 1);
+				}), 0, length);
+				break;
+			case v0_op::push_reg:
+				describe(raw, build([&](zasm::x86::Assembler& a, auto& mark) {
+					a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::rbx, placeholder));
+					mark(4, v0_jit_hole::vreg, 1);
+					a.sub(vsp, s);
+					a.mov(stack_slot(bits, vsp), d[bits]);
+				}), 0, length);
+				break;
+			case v0_op::pop:
+				describe(raw, build([&](zasm::x86::Assembler& a, auto& mark) {
+					a.mov(c[bits], stack_slot(bits, vsp));
+					a.add(vsp, s);
+
+					// writing a 32-bit register clears the upper half
+					//
+					if (bits == 0b10)
+						a.mov(zasm::x86::qword_ptr(zasm::x86::rbx, placeholder), zasm::x86::rcx);
+					else
+						a.mov(stack_slot(bits, zasm::x86::rbx, placeholder), c[bits]);
+					mark(4, v0_jit_hole::vreg, 1);
+				}), 0, length);
+				break;
+			case v0_op::read:
+				describe(raw, build([&](zasm::x86::Assembler& a, auto& mark) {
+					a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(vsp));
+					a.add(vsp, 8 - s);
+					a.mov(c[bits], stack_slot(bits, zasm::x86::rdx));
+					a.mov(stack_slot(bits, vsp), c[bits]);
+				}), 0, length);
+				break;
+			case v0_op::write:
+				describe(raw, build([&](zasm::x86::Assembler& a, auto& mark) {
+					a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::rbx, placeholder));
+					mark(4, v0_jit_hole::vreg, 1);
+					a.mov(zasm::x86::r10, zasm::x86::qword_ptr(vsp));
+					a.mov(stack_slot(bits, zasm::x86::r10), d[bits]);
+					a.add(vsp, 8);
+				}), 0, length);
+				break;
+			case v0_op::add:
+				describe(raw, arith([&](zasm::x86::Assembler& a) { a.add(c[bits], d[bits]); a.mov(stack_slot(bits, vsp), c[bits]); }), 0, length);
+				break;
+			case v0_op::sub:
+				describe(raw, arith([&](zasm::x86::Assembler& a) { a.sub(d[bits], c[bits]); a.mov(stack_slot(bits, vsp), d[bits]); }), 0, length);
+				break;
+			case v0_op::bxor:
+				describe(raw, arith([&](zasm::x86::Assembler& a) { a.xor_(d[bits], c[bits]); a.mov(stack_slot(bits, vsp), d[bits]); }), 0, length);
+				break;
+			case v0_op::band:
+				describe(raw, arith([&](zasm::x86::Assembler& a) { a.and_(d[bits], c[bits]); a.mov(stack_slot(bits, vsp), d[bits]); }), 0, length);
+				break;
+			case v0_op::bor:
+				describe(raw, arith([&](zasm::x86::Assembler& a) { a.or_(d[bits], c[bits]); a.mov(stack_slot(bits, vsp), d[bits]); }), 0, length);
+				break;
+			case v0_op::cmp:
+				describe(raw, compare([&](zasm::x86::Assembler& a) { a.cmp(d[bits], c[bits]); }), 0, length);
+				break;
+			case v0_op::test:
+				describe(raw, compare([&](zasm::x86::Assembler& a) { a.test(d[bits], c[bits]); }), 0, length);
+				break;
+			case v0_op::ea:
+				describe(raw, ea, 0, length);
+				break;
+			case v0_op::jmp:
+				describe(raw, jmp, 0, length);
+				break;
+			case v0_op::jcc:
+				describe(raw, jcc, 0, length);
+				break;
+			case v0_op::vm_enter:
+			case v0_op::vm_exit:
+			case v0_op::call:
+			case v0_op::ret:
+			case v0_op::jit_resume:
+				describe(raw, leave, 0, length);
+				break;
+			case v0_op::jmp_table:
+				describe(raw, leave, jit_word_length, length);
+				break;
+			case v0_op::execute_native:
+				describe(raw, callout, jit_callout | jit_byte_length, length);
+				break;
+			default:
+				describe(raw, callout, jit_callout, length);
+				break;
+			}
+		}
+	}
+
+	return { descriptors, blob };
+}
+
 // to-do: ugly code, refactor plz, this was rush job
 //
 void covirt::vm::debug::dump_v0(lift_result& result)
@@ -175,8 +1461,14 @@ void covirt::vm::debug::dump_v0(lift_result& result)
 	std::println("| off | idx | lifted from                          | vm instruction             | expression");
 	std::println("|-----|-----|--------------------------------------|----------------------------|---------------------------");
 
+	// undo the opcode assignment of the vm this bytecode was lifted for
+	//
+	std::array<uint8_t, 64> decode;
+	for (int i = 0; i < 64; i++)
+		decode[result.opcode_map[i]] = uint8_t(i);
+
 	for (int i = 0; i < bytes.size();) {
-		uint8_t opcode = bytes[i] & 0b00111111;
+		uint8_t opcode = decode[bytes[i] & 0b00111111];
 		uint8_t size = 1 << (bytes[i] >> 6);
 
 		std::print("| {:>12} | {:>12} | {:<36} | ", out::red(i), out::red(x), equivs.contains(x) ? equivs[x] : "");
@@ -185,8 +1477,13 @@ void covirt::vm::debug::dump_v0(lift_result& result)
 		switch (opcode) {
 			using enum v0_op;
 			case int(vm_exit) :
-				std::println("{:<26} | goto {} + {}", "vmexit", out::purple("retaddr"), out::value(*(uint16_t*)(&bytes[i + 1])));
-				i += 2;
+				if (size == 8) {
+					auto a = expression_stack.top(); expression_stack.pop();
+					std::println("{:<26} | goto {}", "vmexit", a);
+					break;
+				}
+				std::println("{:<26} | goto {} + {}", "vmexit", out::purple("retaddr"), out::value(*(int32_t*)(&bytes[i + 1])));
+				i += 4;
 				break;
 				case int(push_imm) :
 					std::print("push{} ", suffix[bytes[i] >> 6]);
@@ -256,9 +1553,27 @@ void covirt::vm::debug::dump_v0(lift_result& result)
 						expression_stack.push(out::purple(std::format("t{}", r++)));
 						break;
 						case int(cmp) :
-							std::println("{:<26} | ", std::format("cmp{}", suffix[bytes[i] >> 6]));
-							expression_stack.push(out::purple(std::format("flags", r++)));
-							break;
+							std::print("{:<26} | ", std::format("cmp{}", suffix[bytes[i] >> 6]));
+						{
+							auto a = expression_stack.top(); expression_stack.pop();
+							auto b = expression_stack.top(); expression_stack.pop();
+							std::println("{} = cmp({}, {})", out::purple("flags"), b, a);
+						}
+						break;
+						case int(shift) :
+						{
+							static const char *kinds[] = { "shl", "shr", "sar", "rol", "ror" };
+							static const char *ops[] = { "<<", ">>", ">>", "rol", "ror" };
+							auto kind = bytes[i + 1] % 5;
+							std::print("{:<26} | ", std::format("{}{}", kinds[kind], suffix[bytes[i] >> 6]));
+
+							auto a = expression_stack.top(); expression_stack.pop();
+							auto b = expression_stack.top(); expression_stack.pop();
+							std::println("{} = {} {} {}", out::purple(std::format("t{}", r)), b, ops[kind], a);
+							expression_stack.push(out::purple(std::format("t{}", r++)));
+							i++;
+						}
+						break;
 							case int(jmp) :
 							{
 								std::println("{:<26} | goto {}", "jmp", out::red(*(uint16_t*)(&bytes[i + 1])));
@@ -267,6 +1582,11 @@ void covirt::vm::debug::dump_v0(lift_result& result)
 							break;
 							case int(call) :
 							{
+								if (size == 8) {
+									auto a = expression_stack.top(); expression_stack.pop();
+									std::println("{:<26} | call {}", "call", a);
+									break;
+								}
 								std::println("{:<26} | goto {}", "call", out::red(*(uint16_t*)(&bytes[i + 1])));
 								i += 4;
 							}
@@ -283,14 +1603,258 @@ void covirt::vm::debug::dump_v0(lift_result& result)
 								i += bytes[i + 1] + 1;
 							}
 							break;
-							default:
-								if (opcode >= int(jz) && opcode <= int(jnle))
-								{
+							case int(jcc) :
+							{
+								static const char *conditions[] = { "o", "no", "b", "nb", "z", "nz", "be", "nbe", "s", "ns", "p", "np", "l", "nl", "le", "nle" };
+								std::println("{:<26} | using {} goto {}", std::format("j{}", conditions[bytes[i + 1] & 0xf]), out::purple("flags"), out::red(*(uint16_t*)(&bytes[i + 2])));
+								i += 3;
+							}
+							break;
+							case int(vec) :
+							{
+								static const char *kinds[] = { "mov", "store", "paddb", "paddw", "paddd", "paddq", "psubb", "psubw", "psubd", "psubq", "pand", "pandn", "por", "pxor", "pcmpeqb", "pcmpeqw", "pcmpeqd", "pshufb" };
+								auto kind = bytes[i + 1];
+								auto reg = [&](uint8_t idx) { return out::green(std::format("{}{}", kind & vec_ymm ? "ymm" : "xmm", idx)); };
+
+								std::string src2 = reg(bytes[i + 4]);
+								if (bytes[i + 4] == vec_memory) {
+									src2 = std::format("[{}]", expression_stack.top());
+									expression_stack.pop();
+								}
+
+								auto name = std::format("vec.{}", kinds[kind & (vec_ymm - 1)]);
+								if ((kind & (vec_ymm - 1)) == int(v0_vec_op::store))
+									std::println("{:<26} | {} = {}", name, src2, reg(bytes[i + 3]));
+								else
+									std::println("{:<26} | {} = {}({}, {})", name, reg(bytes[i + 2]), kinds[kind & (vec_ymm - 1)], reg(bytes[i + 3]), src2);
+								i += 4;
+							}
+							break;
+							case int(rep) :
+							{
+								static const char *ops[] = { "movs", "stos", "cmps", "scas" };
+								auto kind = bytes[i + 1];
+								std::println("{:<26} | ", std::format("{} {}{}", kind & rep_ne ? "repne" : "rep", ops[kind & 0b11], suffix[bytes[i] >> 6]));
+								i++;
+							}
+							break;
+							case int(mul) :
+							{
+								static const char *kinds[] = { "imul", "mul", "imul", "div", "idiv" };
+								auto kind = bytes[i + 1] % 5;
+								std::print("{:<26} | ", std::format("{}{}", kinds[kind], suffix[bytes[i] >> 6]));
+
+								auto a = expression_stack.top(); expression_stack.pop();
+								if (kind == int(v0_mul_op::imul2)) {
+									auto b = expression_stack.top(); expression_stack.pop();
+									std::println("{} = {} * {}", out::purple(std::format("t{}", r)), b, a);
+									expression_stack.push(out::purple(std::format("t{}", r++)));
+								}
+								else if (kind <= int(v0_mul_op::imul))
+									std::println("{} = {} * {}", out::green("v2:v0"), out::green("v0"), a);
+								else
+									std::println("{} = {} / {}", out::green("v0, v2"), out::green("v2:v0"), a);
+								i++;
+							}
+							break;
+							case int(test) :
+							{
+								auto a = expression_stack.top(); expression_stack.pop();
+								auto b = expression_stack.top(); expression_stack.pop();
+								std::println("{:<26} | {} = test({}, {})", std::format("test{}", suffix[bytes[i] >> 6]), out::purple("flags"), b, a);
+							}
+							break;
+							case int(setcc) :
+							case int(cmov) :
+							{
+								static const char *conditions[] = { "o", "no", "b", "nb", "z", "nz", "be", "nbe", "s", "ns", "p", "np", "l", "nl", "le", "nle" };
+								auto cc = conditions[bytes[i + 1] & 0xf];
+
+								if (opcode == int(setcc)) {
+									std::println("{:<26} | {} = {}({})", std::format("set{}", cc), out::purple(std::format("t{}", r)), cc, out::purple("flags"));
+								}
+								else {
 									auto a = expression_stack.top(); expression_stack.pop();
-									std::println("{:<26} | using {} goto {}", "jcc", a, out::red(*(uint16_t*)(&bytes[i + 1])));
-									i += 2;
-									break;
+									auto b = expression_stack.top(); expression_stack.pop();
+									std::println("{:<26} | {} = {}({}) ? {} : {}", std::format("cmov{}{}", cc, suffix[bytes[i] >> 6]), out::purple(std::format("t{}", r)), cc, out::purple("flags"), a, b);
 								}
+								expression_stack.push(out::purple(std::format("t{}", r++)));
+								i++;
+							}
+							break;
+							case int(ext) :
+							{
+								static const char *kinds[] = { "zext", "sext", "sign" };
+								auto kind = kinds[(bytes[i + 1] >> 2) % 3];
+								auto to = 8 << (bytes[i + 1] & 0b11);
+
+								auto a = expression_stack.top(); expression_stack.pop();
+								std::println("{:<26} | {} = {}{}({})", std::format("{}{}", kind, suffix[bytes[i] >> 6]), out::purple(std::format("t{}", r)), kind, to, a);
+								expression_stack.push(out::purple(std::format("t{}", r++)));
+								i++;
+							}
+							break;
+							case int(ea) :
+							{
+								auto base = bytes[i + 1], index = bytes[i + 2];
+								std::string exp;
+								if (base != ea_none)
+									exp = out::green(std::format("v{}", base));
+								if (index != ea_none)
+									exp += std::format("{}{}*{}", exp.empty() ? "" : " + ", out::green(std::format("v{}", index)), 1 << (bytes[i + 3] & 3));
+								exp += std::format("{}{}", exp.empty() ? "" : " + ", out::value(*(int32_t*)(&bytes[i + 4])));
+								if (bytes[i + 3] & (ea_fs | ea_gs))
+									exp = std::format("{}:{}", bytes[i + 3] & ea_fs ? "fs" : "gs", exp);
+
+								std::println("{:<26} | ", "ea");
+								expression_stack.push(std::format("({})", exp));
+								i += 7;
+							}
+							break;
+							case int(spush) :
+							{
+								auto a = expression_stack.top(); expression_stack.pop();
+								std::println("{:<26} | *--{} = {}", "spush", out::green("v4"), a);
+							}
+							break;
+							case int(spop) :
+							{
+								std::println("{:<26} | {} = *{}++", "spop", out::purple(std::format("t{}", r)), out::green("v4"));
+								expression_stack.push(out::purple(std::format("t{}", r++)));
+							}
+							break;
+							case int(ret) :
+							{
+								std::println("{:<26} | goto *{}++, {} += {}", "ret", out::green("v4"), out::green("v4"), out::value(*(uint16_t*)(&bytes[i + 1])));
+								i += 2;
+							}
+							break;
+							case int(jmp_table) :
+							{
+								auto count = *(uint16_t*)(&bytes[i + 1]);
+								auto a = expression_stack.top(); expression_stack.pop();
+
+								std::string cases;
+								for (int n = 0; n < count; n++)
+									cases += std::format("{}{}", n ? ", " : "", out::red(*(uint16_t*)(&bytes[i + 3 + n * 2])));
+								std::println("{:<26} | goto [{}][{}]", "jmp_table", cases, a);
+								i += 2 + count * 2;
+							}
+							break;
+							case int(atomic) :
+							{
+								static const char *kinds[] = { "xchg", "xadd", "cmpxchg", "add", "sub", "and", "or", "xor", "inc", "dec" };
+								auto kind = bytes[i + 1] % 10;
+
+								auto a = expression_stack.top(); expression_stack.pop();
+								std::println("{:<26} | lock {} [{}]", std::format("atomic.{}{}", kinds[kind], suffix[bytes[i] >> 6]), kinds[kind], a);
+								if (kind != int(v0_atomic_op::inc) && kind != int(v0_atomic_op::dec))
+									expression_stack.pop();
+								if (kind == int(v0_atomic_op::cmpxchg))
+									expression_stack.pop();
+								if (kind <= int(v0_atomic_op::cmpxchg))
+									expression_stack.push(out::purple(std::format("t{}", r++)));
+								i++;
+							}
+							break;
+							case int(bitop) :
+							{
+								static const char *kinds[] = { "bt", "bts", "btr", "btc", "bsf", "bsr", "popcnt", "lzcnt", "tzcnt", "andn", "blsr", "blsi", "blsmsk", "pext", "pdep" };
+								auto kind = bytes[i + 1] % 15;
+								bool unary = (kind >= int(v0_bit_op::popcnt) && kind <= int(v0_bit_op::tzcnt)) || (kind >= int(v0_bit_op::blsr) && kind <= int(v0_bit_op::blsmsk));
+
+								auto a = expression_stack.top(); expression_stack.pop();
+								std::string b;
+								if (!unary) { b = expression_stack.top(); expression_stack.pop(); }
+
+								std::print("{:<26} | ", std::format("{}{}", kinds[kind], suffix[bytes[i] >> 6]));
+								if (kind == int(v0_bit_op::bt))
+									std::println("{} = bt({}, {})", out::purple("flags"), b, a);
+								else {
+									std::println("{} = {}({}{}{})", out::purple(std::format("t{}", r)), kinds[kind], b, unary ? "" : ", ", a);
+									expression_stack.push(out::purple(std::format("t{}", r++)));
+								}
+								i++;
+							}
+							break;
+							case int(arith) :
+							{
+								static const char *kinds[] = { "add", "sub", "and", "or", "xor", "adc", "sbb" };
+								static const char *ops[] = { "+", "-", "&", "|", "^", "+", "-" };
+								auto kind = bytes[i + 1] % 7;
+
+								auto a = expression_stack.top(); expression_stack.pop();
+								auto b = expression_stack.top(); expression_stack.pop();
+								std::print("{:<26} | ", std::format("{}{}.f", kinds[kind], suffix[bytes[i] >> 6]));
+								if (kind >= int(v0_arith_op::adc))
+									std::println("{}, {} = {} {} {} {} cf", out::purple(std::format("t{}", r)), out::purple("flags"), b, ops[kind], a, ops[kind]);
+								else
+									std::println("{}, {} = {} {} {}", out::purple(std::format("t{}", r)), out::purple("flags"), b, ops[kind], a);
+								expression_stack.push(out::purple(std::format("t{}", r++)));
+								i++;
+							}
+							break;
+							case int(dup) :
+							{
+								std::println("{:<26} | ", std::format("dup{}", suffix[bytes[i] >> 6]));
+								expression_stack.push(expression_stack.top());
+							}
+							break;
+							case int(swap) :
+							{
+								std::println("{:<26} | ", std::format("swap{}", suffix[bytes[i] >> 6]));
+								auto a = expression_stack.top(); expression_stack.pop();
+								auto b = expression_stack.top(); expression_stack.pop();
+								expression_stack.push(a);
+								expression_stack.push(b);
+							}
+							break;
+							case int(over) :
+							{
+								std::println("{:<26} | ", std::format("over{}", suffix[bytes[i] >> 6]));
+								auto a = expression_stack.top(); expression_stack.pop();
+								auto b = expression_stack.top();
+								expression_stack.push(a);
+								expression_stack.push(b);
+							}
+							break;
+							case int(intrinsic) :
+							{
+								static const char *kinds[] = { "memcpy", "memmove", "memset", "memcmp", "strlen" };
+								auto reg = [&](uint8_t idx) { return out::green(std::format("v{}", idx)); };
+								std::println("{:<26} | {} = {}({}, {}, {})", "intrinsic", out::green("v0"), kinds[bytes[i + 1] % std::size(kinds)], reg(bytes[i + 2]), reg(bytes[i + 3]), reg(bytes[i + 4]));
+								i += 4;
+							}
+							break;
+							case int(fp) :
+							{
+								static const char *kinds[] = { "mov", "load", "store", "add", "sub", "mul", "div", "min", "max", "sqrt", "ucomi", "comi", "cvtsi2", "cvtsi2", "cvtt2si", "cvtt2si", "cvt" };
+								auto kind = v0_fp_op(bytes[i + 1] % std::size(kinds));
+								auto xmm = [&](uint8_t idx) { return out::green(std::format("xmm{}", idx)); };
+								auto name = std::format("fp.{}{}", kinds[int(kind)], bytes[i] >> 6 == 0b11 ? "sd" : "ss");
+
+								std::string src = xmm(bytes[i + 3]);
+								if (bytes[i + 3] == vec_memory || kind == v0_fp_op::cvtsi2_32 || kind == v0_fp_op::cvtsi2_64) {
+									src = expression_stack.top();
+									if (bytes[i + 3] == vec_memory)
+										src = std::format("[{}]", src);
+									expression_stack.pop();
+								}
+
+								if (kind == v0_fp_op::store)
+									std::println("{:<26} | {} = {}", name, src, xmm(bytes[i + 2]));
+								else if (kind == v0_fp_op::ucomi || kind == v0_fp_op::comi)
+									std::println("{:<26} | {} = {} <=> {}", name, out::purple("flags"), xmm(bytes[i + 2]), src);
+								else if (kind == v0_fp_op::cvtt2si_32 || kind == v0_fp_op::cvtt2si_64) {
+									std::println("{:<26} | {} = {}({})", name, out::purple(std::format("t{}", r)), kinds[int(kind)], src);
+									expression_stack.push(out::purple(std::format("t{}", r++)));
+								}
+								else
+									std::println("{:<26} | {} = {}({}, {})", name, xmm(bytes[i + 2]), kinds[int(kind)], xmm(bytes[i + 2]), src);
+								i += 3;
+							}
+							break;
+							default:
 								std::println("{:<35} | ", std::format("(bad:{:x})", bytes[i]));
 								break;
 		}
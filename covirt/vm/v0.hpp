@@ -3,15 +3,119 @@
 #include <compiler/generic_vm.hpp>
 #include <compiler/default_vm_enter.hpp>
 
+#include <bit>
 #include <optional>
 
 #include <zasm/zasm.hpp>
 
 namespace covirt::vm {
     enum class v0_op : uint8_t {
-        vm_enter, vm_exit, push_imm, push_reg, pop, read, write, add, sub, bxor, band, bor, cmp, jmp, jz, jnz, jb, jnb, jbe, jnbe, jl, jle, jnl, jnle, call, lea, execute_native
+        vm_enter, vm_exit, push_imm, push_reg, pop, read, write, add, sub, bxor, band, bor, cmp, jmp, jcc, call, lea, execute_native, vec, rep, ea, shift, mul, test, setcc, cmov, ext, spush, spop, ret, jmp_table, atomic, bitop, arith, fp, dup, swap, over, intrinsic, jit_resume
     };
 
+    // operation of the `shift` handler
+    //
+    enum class v0_shift_op : uint8_t {
+        shl, shr, sar, rol, ror
+    };
+
+    // operation of the `mul` handler, `imul2` multiplies the two top stack entries,
+    // the others are the one operand forms working on the guest's rax and rdx
+    //
+    enum class v0_mul_op : uint8_t {
+        imul2, mul, imul, div, idiv
+    };
+
+    // conversion done by `ext`, whose size bits are the source's; `sign` fills the
+    // result with the source's sign bit (cdq, cqo)
+    //
+    enum class v0_ext_op : uint8_t {
+        zext, sext, sign
+    };
+
+    // operation of the `atomic` handler, run as the locked instruction on the
+    // address at the top of the stack
+    //
+    enum class v0_atomic_op : uint8_t {
+        xchg, xadd, cmpxchg, add, sub, band, bor, bxor, inc, dec
+    };
+
+    // operation of the `bitop` handler; the unary ones (popcnt through tzcnt, the
+    // bls* group) take one stack slot, the others two, and `bt` only sets flags
+    //
+    enum class v0_bit_op : uint8_t {
+        bt, bts, btr, btc, bsf, bsr, popcnt, lzcnt, tzcnt, andn, blsr, blsi, blsmsk, pext, pdep
+    };
+
+    // operation of the `arith` handler, the flag writing counterpart of `add`,
+    // `sub`, `band`, `bor` and `bxor`; `adc`/`sbb` take CF from the vm flags
+    //
+    enum class v0_arith_op : uint8_t {
+        add, sub, band, bor, bxor, adc, sbb
+    };
+
+    // `ea` register operand meaning no base/index
+    //
+    static constexpr uint8_t ea_none = 0xff;
+
+    // set in the `ea` shift byte for fs:/gs: operands, the segment base is added
+    // to the address
+    //
+    static constexpr uint8_t ea_fs = 0x40;
+    static constexpr uint8_t ea_gs = 0x80;
+
+    // operations of the `vec` handler, encoded as `kind, dst, src1, src2` where the
+    // operands index the xmm/ymm register file
+    //
+    enum class v0_vec_op : uint8_t {
+        mov, store, paddb, paddw, paddd, paddq, psubb, psubw, psubd, psubq, pand, pandn, por, pxor, pcmpeqb, pcmpeqw, pcmpeqd, pshufb
+    };
+
+    // set in `kind` for the 256-bit form
+    //
+    static constexpr uint8_t vec_ymm = 0x20;
+
+    // `src2` (or the destination of `store`) is a memory address popped from the vstack
+    //
+    static constexpr uint8_t vec_memory = 0xff;
+
+    // scalar operation of the `fp` handler, encoded as `kind, dst, src` over the
+    // same register file as `vec`; the size bits pick ss (4) or sd (8), for the
+    // cvt* kinds that's the floating point side. `load` is movs* from memory
+    // (zeroing the rest of dst), `store` writes dst's low element to memory and
+    // the integer side of cvtsi2/cvtt2si travels on the vstack
+    //
+    enum class v0_fp_op : uint8_t {
+        mov, load, store, add, sub, mul, div, min, max, sqrt, ucomi, comi, cvtsi2_32, cvtsi2_64, cvtt2si_32, cvtt2si_64, cvts2s
+    };
+
+    // library function done by the `intrinsic` handler, encoded as `kind, a0, a1, a2`
+    // where the operands are the registers holding the first three arguments
+    //
+    enum class v0_intrinsic : uint8_t {
+        memcpy, memmove, memset, memcmp, strlen
+    };
+
+    // how the jit tier patches a template, the operand is the byte offset of the
+    // field in the vm instruction; `vreg` turns a register index into its context
+    // offset, `branch` a bytecode target into the rel32 of its translation and `ip`
+    // stores the instruction's own bytecode offset
+    //
+    enum class v0_jit_hole : uint8_t {
+        none, copy1, copy2, copy4, copy8, vreg, branch, ip
+    };
+
+    // string instruction repeated by the `rep` handler, the element size is
+    // carried in the opcode's size bits
+    //
+    enum class v0_rep_op : uint8_t {
+        movs, stos, cmps, scas
+    };
+
+    // set in `kind` for the repne prefix, otherwise rep/repe
+    //
+    static constexpr uint8_t rep_ne = 0x80;
+
     class v0_emitter : public generic_emitter {
     public:
     #define LAZY_EMIT(x) \
@@ -35,6 +139,28 @@ namespace covirt::vm {
         LAZY_EMIT(cmp);
         LAZY_EMIT(lea);
         LAZY_EMIT(call);
+        LAZY_EMIT(ea);
+        LAZY_EMIT(shift);
+        LAZY_EMIT(mul);
+        LAZY_EMIT(test);
+        LAZY_EMIT(cmov);
+        LAZY_EMIT(spush);
+        LAZY_EMIT(spop);
+        LAZY_EMIT(ret);
+        LAZY_EMIT(atomic);
+        LAZY_EMIT(bitop);
+        LAZY_EMIT(arith);
+        LAZY_EMIT(dup);
+        LAZY_EMIT(swap);
+        LAZY_EMIT(over);
+
+        // `kind` and the destination size share a byte
+        //
+        auto& ext(size_t src_size, v0_ext_op kind, size_t dst_size)
+        {
+            emplace(opcode(v0_op::ext, src_size), uint8_t(uint8_t(kind) << 2 | std::countr_zero(dst_size)));
+            return *this;
+        }
     #undef LAZY_EMIT
     };
 
@@ -52,9 +178,9 @@ namespace covirt::vm {
             return e;
         }
 
-        void vm_exit(uint16_t bytes_to_skip) override
+        void vm_exit(int32_t rva) override
         {
-            e >> e.opcode(v0_op::vm_exit, 1) >> uint16_t(bytes_to_skip);
+            e >> e.opcode(v0_op::vm_exit, 1) >> int32_t(rva);
         }
 
         void native(uint8_t *ins_bytes, size_t length) override
@@ -63,13 +189,53 @@ namespace covirt::vm {
             for (int i = 0; i < length; i++) e >> ins_bytes[i];
         } 
 
+        void jump_table_index(int index_register) override
+        {
+            e.push_reg(8, uint8_t(index_register));
+        }
+
+        void jump_table(std::vector<basic_block*> &targets) override
+        {
+            e >> e.opcode(v0_op::jmp_table, 1) >> uint16_t(targets.size());
+            for (auto bb : targets) {
+                e >> uint16_t(0);
+                fill_in_gaps.push_back({ bb, e.get().size() - sizeof(uint16_t), sizeof(uint16_t) });
+            }
+        }
+
+        void enter_inline(int32_t return_rva) override
+        {
+            e.lea(8, return_rva);
+            e.spush(8);
+        }
+
+        void leave_inline() override
+        {
+            e.spop(8);
+            e.pop(8, uint8_t(tmp_reg_idx));
+        }
+
+        bool intrinsic(const std::string &name) override;
+
     private:
-        static constexpr uint8_t tmp_reg_idx = 14;
+        // scratch slot after the 16 guest registers
+        //
+        static constexpr uint8_t tmp_reg_idx = 16;
 
-        void push_address(covirt::zydis_operand &operand);
+        void push_address(covirt::zydis_operand &operand, bool segment = true);
         void push_operand(covirt::zydis_operand &operand, std::optional<int> override_size = {});
         void pop_operand(covirt::zydis_operand &operand, std::optional<int> override_size = {}, std::optional<covirt::zydis_operand> src = {});
 
+        // read-modify-write forms of the above, the address of a memory operand is
+        // computed once and stays under the value until `pop_rmw_operand` writes it
+        //
+        void push_rmw_operand(covirt::zydis_operand &operand, std::optional<int> override_size = {});
+        void pop_rmw_operand(covirt::zydis_operand &operand, std::optional<int> override_size = {});
+        bool lift_vector(v0_vec_op op);
+        bool lift_string(v0_rep_op op, size_t size);
+        bool lift_scalar(v0_fp_op op, size_t width);
+        bool lift_atomic(v0_atomic_op op, covirt::zydis_operand &dst, covirt::zydis_operand &src);
+
         std::map<ZydisMnemonic, fn_instruction_translator_t> lift_impl = {
             {
                 ZYDIS_MNEMONIC_MOV, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
@@ -88,10 +254,15 @@ namespace covirt::vm {
 #define LAZY_ARITH(mnemonic, op) \
             { \
                 mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
-                    push_operand(dst); \
+                    if (instruction->info.attributes & ZYDIS_ATTRIB_HAS_LOCK) \
+                        return lift_atomic(v0_atomic_op::op, dst, src); \
+                    push_rmw_operand(dst); \
                     push_operand(src, dst.size); \
-                    e.op(dst.size); \
-                    pop_operand(dst); \
+                    if (flags_live) \
+                        e.arith(dst.size, uint8_t(v0_arith_op::op)); \
+                    else \
+                        e.op(dst.size); \
+                    pop_rmw_operand(dst); \
                     return true; \
                 } \
             }
@@ -103,6 +274,147 @@ namespace covirt::vm {
             LAZY_ARITH(ZYDIS_MNEMONIC_OR, bor),
 #undef LAZY_ARITH
 
+#define LAZY_CARRY(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    if (instruction->info.attributes & ZYDIS_ATTRIB_HAS_LOCK) \
+                        return false; \
+                    push_rmw_operand(dst); \
+                    push_operand(src, dst.size); \
+                    e.arith(dst.size, uint8_t(op)); \
+                    pop_rmw_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_CARRY(ZYDIS_MNEMONIC_ADC, v0_arith_op::adc),
+            LAZY_CARRY(ZYDIS_MNEMONIC_SBB, v0_arith_op::sbb),
+#undef LAZY_CARRY
+
+            {
+                ZYDIS_MNEMONIC_XCHG, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (dst.is_memory() || src.is_memory())
+                        return lift_atomic(v0_atomic_op::xchg, dst, src);
+
+                    push_operand(dst);
+                    push_operand(src);
+                    pop_operand(dst);
+                    pop_operand(src);
+                    return true;
+                }
+            },
+
+#define LAZY_BIT_TEST(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    if ((dst.is_memory() && !src.is_immediate()) || (instruction->info.attributes & ZYDIS_ATTRIB_HAS_LOCK)) \
+                        return false; \
+                    if (op == v0_bit_op::bt) \
+                        push_operand(dst); \
+                    else \
+                        push_rmw_operand(dst); \
+                    push_operand(src, dst.size); \
+                    e.bitop(dst.size, uint8_t(op)); \
+                    if (op != v0_bit_op::bt) \
+                        pop_rmw_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_BIT_TEST(ZYDIS_MNEMONIC_BT, v0_bit_op::bt),
+            LAZY_BIT_TEST(ZYDIS_MNEMONIC_BTS, v0_bit_op::bts),
+            LAZY_BIT_TEST(ZYDIS_MNEMONIC_BTR, v0_bit_op::btr),
+            LAZY_BIT_TEST(ZYDIS_MNEMONIC_BTC, v0_bit_op::btc),
+#undef LAZY_BIT_TEST
+
+// bsf/bsr leave the destination alone for a zero source, so it goes in too
+//
+#define LAZY_BIT_SCAN(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    push_operand(dst); \
+                    push_operand(src); \
+                    e.bitop(dst.size, uint8_t(op)); \
+                    pop_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_BIT_SCAN(ZYDIS_MNEMONIC_BSF, v0_bit_op::bsf),
+            LAZY_BIT_SCAN(ZYDIS_MNEMONIC_BSR, v0_bit_op::bsr),
+#undef LAZY_BIT_SCAN
+
+#define LAZY_BIT_UNARY(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    push_operand(src); \
+                    e.bitop(dst.size, uint8_t(op)); \
+                    pop_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_BIT_UNARY(ZYDIS_MNEMONIC_POPCNT, v0_bit_op::popcnt),
+            LAZY_BIT_UNARY(ZYDIS_MNEMONIC_LZCNT, v0_bit_op::lzcnt),
+            LAZY_BIT_UNARY(ZYDIS_MNEMONIC_TZCNT, v0_bit_op::tzcnt),
+            LAZY_BIT_UNARY(ZYDIS_MNEMONIC_BLSR, v0_bit_op::blsr),
+            LAZY_BIT_UNARY(ZYDIS_MNEMONIC_BLSI, v0_bit_op::blsi),
+            LAZY_BIT_UNARY(ZYDIS_MNEMONIC_BLSMSK, v0_bit_op::blsmsk),
+#undef LAZY_BIT_UNARY
+
+#define LAZY_BIT_VEX(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    covirt::zydis_operand src2(instruction->operands[2]); \
+                    push_operand(src); \
+                    push_operand(src2); \
+                    e.bitop(dst.size, uint8_t(op)); \
+                    pop_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_BIT_VEX(ZYDIS_MNEMONIC_ANDN, v0_bit_op::andn),
+            LAZY_BIT_VEX(ZYDIS_MNEMONIC_PEXT, v0_bit_op::pext),
+            LAZY_BIT_VEX(ZYDIS_MNEMONIC_PDEP, v0_bit_op::pdep),
+#undef LAZY_BIT_VEX
+
+#define LAZY_ATOMIC(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    if (!(instruction->info.attributes & ZYDIS_ATTRIB_HAS_LOCK)) \
+                        return false; \
+                    return lift_atomic(op, dst, src); \
+                } \
+            }
+
+            LAZY_ATOMIC(ZYDIS_MNEMONIC_CMPXCHG, v0_atomic_op::cmpxchg),
+            LAZY_ATOMIC(ZYDIS_MNEMONIC_INC, v0_atomic_op::inc),
+            LAZY_ATOMIC(ZYDIS_MNEMONIC_DEC, v0_atomic_op::dec),
+#undef LAZY_ATOMIC
+
+            {
+                ZYDIS_MNEMONIC_XADD, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (instruction->info.attributes & ZYDIS_ATTRIB_HAS_LOCK)
+                        return lift_atomic(v0_atomic_op::xadd, dst, src);
+
+                    // dst, src -> dst, src, dst -> dst, sum -> sum, dst; src takes the
+                    // old value before dst is written, as on x86 when both are the same
+                    //
+                    push_rmw_operand(dst);
+                    push_operand(src);
+                    e.over(dst.size);
+                    if (flags_live)
+                        e.arith(dst.size, uint8_t(v0_arith_op::add));
+                    else
+                        e.add(dst.size);
+                    e.swap(dst.size);
+                    pop_operand(src);
+                    pop_rmw_operand(dst);
+                    return true;
+                }
+            },
+
             {
                 ZYDIS_MNEMONIC_CMP, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
                     push_operand(dst);
@@ -111,45 +423,412 @@ namespace covirt::vm {
                     return true; \
                 }
             },
+            {
+                ZYDIS_MNEMONIC_TEST, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    push_operand(dst);
+                    push_operand(src, dst.size);
+                    e.test(dst.size);
+                    return true;
+                }
+            },
+
+#define LAZY_SHIFT(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    push_rmw_operand(dst); \
+                    push_operand(src, 1); \
+                    e.shift(dst.size, uint8_t(op)); \
+                    pop_rmw_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_SHIFT(ZYDIS_MNEMONIC_SHL, v0_shift_op::shl),
+            LAZY_SHIFT(ZYDIS_MNEMONIC_SHR, v0_shift_op::shr),
+            LAZY_SHIFT(ZYDIS_MNEMONIC_SAR, v0_shift_op::sar),
+            LAZY_SHIFT(ZYDIS_MNEMONIC_ROL, v0_shift_op::rol),
+            LAZY_SHIFT(ZYDIS_MNEMONIC_ROR, v0_shift_op::ror),
+#undef LAZY_SHIFT
+
+            {
+                ZYDIS_MNEMONIC_IMUL, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    switch (instruction->info.operand_count_visible) {
+                    case 1:
+                        push_operand(dst);
+                        e.mul(dst.size, uint8_t(v0_mul_op::imul));
+                        return true;
+                    case 2:
+                        push_operand(dst);
+                        push_operand(src, dst.size);
+                        break;
+                    case 3: {
+                        covirt::zydis_operand imm(instruction->operands[2]);
+                        push_operand(src);
+                        push_operand(imm, dst.size);
+                        break;
+                    }
+                    default:
+                        return false;
+                    }
+
+                    e.mul(dst.size, uint8_t(v0_mul_op::imul2));
+                    pop_operand(dst);
+                    return true;
+                }
+            },
+
+#define LAZY_MUL(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    push_operand(dst); \
+                    e.mul(dst.size, uint8_t(op)); \
+                    return true; \
+                } \
+            }
+
+            LAZY_MUL(ZYDIS_MNEMONIC_MUL, v0_mul_op::mul),
+            LAZY_MUL(ZYDIS_MNEMONIC_DIV, v0_mul_op::div),
+            LAZY_MUL(ZYDIS_MNEMONIC_IDIV, v0_mul_op::idiv),
+#undef LAZY_MUL
+
+#define LAZY_EXT(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    push_operand(src); \
+                    e.ext(src.size, op, dst.size); \
+                    pop_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_EXT(ZYDIS_MNEMONIC_MOVZX, v0_ext_op::zext),
+            LAZY_EXT(ZYDIS_MNEMONIC_MOVSX, v0_ext_op::sext),
+            LAZY_EXT(ZYDIS_MNEMONIC_MOVSXD, v0_ext_op::sext),
+#undef LAZY_EXT
+
+#define LAZY_EXT_ACC(mnemonic, op, src_size, dst_size, dst_reg) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    e.push_reg(src_size, uint8_t(0)); \
+                    e.ext(src_size, op, dst_size); \
+                    e.pop(dst_size, uint8_t(dst_reg)); \
+                    return true; \
+                } \
+            }
+
+            LAZY_EXT_ACC(ZYDIS_MNEMONIC_CBW, v0_ext_op::sext, 1, 2, 0),
+            LAZY_EXT_ACC(ZYDIS_MNEMONIC_CWDE, v0_ext_op::sext, 2, 4, 0),
+            LAZY_EXT_ACC(ZYDIS_MNEMONIC_CDQE, v0_ext_op::sext, 4, 8, 0),
+            LAZY_EXT_ACC(ZYDIS_MNEMONIC_CWD, v0_ext_op::sign, 2, 2, 2),
+            LAZY_EXT_ACC(ZYDIS_MNEMONIC_CDQ, v0_ext_op::sign, 4, 4, 2),
+            LAZY_EXT_ACC(ZYDIS_MNEMONIC_CQO, v0_ext_op::sign, 8, 8, 2),
+#undef LAZY_EXT_ACC
+
+            {
+                ZYDIS_MNEMONIC_JMP, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (dst.references_bb) {
+                        e >> e.opcode(v0_op::jmp, 1) >> uint16_t(0);
+                        fill_in_gaps.push_back({ dst.references_bb.value(), e.get().size() - sizeof(uint16_t), sizeof(uint16_t) });
+                        return true;
+                    }
+
+                    // indirect jumps which aren't a recovered switch leave the vm
+                    // to the computed target, passed on the stack
+                    //
+                    if (instruction->info.operand_width != 64 || (dst.is_register() && dst.register_index() < 0))
+                        return false;
+
+                    push_operand(dst, 8);
+                    e >> e.opcode(v0_op::vm_exit, 8);
+                    return true;
+                }
+            },
 
-#define LAZY_JUMP(mnemonic, op) \
+#define LAZY_JCC(mnemonic) \
             { \
                 mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
-                    e >> e.opcode(op, 1) >> uint16_t(0); \
+                    e >> e.opcode(v0_op::jcc, 1) >> condition_code(mnemonic).value() >> uint16_t(0); \
                     fill_in_gaps.push_back({ dst.references_bb.value(), e.get().size() - sizeof(uint16_t), sizeof(uint16_t) }); \
                     return true; \
                 } \
             }
 
-            LAZY_JUMP(ZYDIS_MNEMONIC_JMP, v0_op::jmp),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JZ, v0_op::jz),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JNZ, v0_op::jnz),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JB, v0_op::jb),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JNB, v0_op::jnb),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JBE, v0_op::jbe),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JNBE, v0_op::jnbe),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JL, v0_op::jl),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JLE, v0_op::jle),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JNL, v0_op::jnl),
-            LAZY_JUMP(ZYDIS_MNEMONIC_JNLE, v0_op::jnle),
-#undef LAZY_JUMP
+            LAZY_JCC(ZYDIS_MNEMONIC_JO),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNO),
+            LAZY_JCC(ZYDIS_MNEMONIC_JB),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNB),
+            LAZY_JCC(ZYDIS_MNEMONIC_JZ),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNZ),
+            LAZY_JCC(ZYDIS_MNEMONIC_JBE),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNBE),
+            LAZY_JCC(ZYDIS_MNEMONIC_JS),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNS),
+            LAZY_JCC(ZYDIS_MNEMONIC_JP),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNP),
+            LAZY_JCC(ZYDIS_MNEMONIC_JL),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNL),
+            LAZY_JCC(ZYDIS_MNEMONIC_JLE),
+            LAZY_JCC(ZYDIS_MNEMONIC_JNLE),
+#undef LAZY_JCC
+
+#define LAZY_SETCC(mnemonic) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    e >> e.opcode(v0_op::setcc, 1) >> condition_code(mnemonic).value(); \
+                    pop_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETO),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNO),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETB),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNB),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETZ),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNZ),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETBE),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNBE),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETS),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNS),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETP),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNP),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETL),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNL),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETLE),
+            LAZY_SETCC(ZYDIS_MNEMONIC_SETNLE),
+#undef LAZY_SETCC
+
+#define LAZY_CMOV(mnemonic) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    push_operand(dst); \
+                    push_operand(src, dst.size); \
+                    e.cmov(dst.size, condition_code(mnemonic).value()); \
+                    pop_operand(dst); \
+                    return true; \
+                } \
+            }
+
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVO),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNO),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVB),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNB),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVZ),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNZ),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVBE),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNBE),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVS),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNS),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVP),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNP),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVL),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNL),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVLE),
+            LAZY_CMOV(ZYDIS_MNEMONIC_CMOVNLE),
+#undef LAZY_CMOV
 
             {
                 ZYDIS_MNEMONIC_LEA, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
-                    if (src.as_memory().base != ZYDIS_REGISTER_RIP)
+                    if (dst.size == 2)
                         return false;
 
-                    e.lea(dst.size, int32_t(dst.references_rva.value()));
-                    pop_operand(dst);
+                    // lea never applies the segment base
+                    //
+                    push_address(src, false);
+
+                    // 32-bit destinations are zero extended
+                    //
+                    if (dst.size == 4) {
+                        e.push_imm(8, uint64_t(0xffffffff));
+                        e.band(8);
+                    }
+
+                    e.pop(8, static_cast<uint8_t>(dst.register_index()));
+                    return true;
+                }
+            },
+
+            // the guest stack is real memory at v4, `spush`/`spop` move one qword
+            // between it and the vm stack
+            //
+            {
+                ZYDIS_MNEMONIC_PUSH, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (instruction->info.operand_width != 64 || (dst.is_register() && dst.register_index() < 0))
+                        return false;
+
+                    push_operand(dst, 8);
+                    e.spush(8);
+                    return true;
+                }
+            },
+            {
+                ZYDIS_MNEMONIC_POP, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (instruction->info.operand_width != 64 || (dst.is_register() && dst.register_index() < 0))
+                        return false;
+
+                    // a memory destination is addressed with the incremented rsp, as on x86
+                    //
+                    e.spop(8);
+                    pop_operand(dst, 8);
+                    return true;
+                }
+            },
+            {
+                ZYDIS_MNEMONIC_LEAVE, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (instruction->info.operand_width != 64)
+                        return false;
+
+                    e.push_reg(8, uint8_t(5));
+                    e.pop(8, uint8_t(4));
+                    e.spop(8);
+                    e.pop(8, uint8_t(5));
+                    return true;
+                }
+            },
+            {
+                ZYDIS_MNEMONIC_RET, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (instruction->info.operand_width != 64)
+                        return false;
+
+                    e.ret(1, uint16_t(dst.is_immediate() ? dst.immediate() : 0));
                     return true;
                 }
             },
             {
                 ZYDIS_MNEMONIC_CALL, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
-                    e.call(1, int32_t(dst.references_rva.value()));
+                    if (dst.is_immediate()) {
+                        e.call(1, int32_t(dst.references_rva.value()));
+                        return true;
+                    }
+
+                    // indirect calls (function pointers, vtables, the got) pass the
+                    // target on the stack
+                    //
+                    if (instruction->info.operand_width != 64 || (dst.is_register() && dst.register_index() < 0))
+                        return false;
+
+                    push_operand(dst, 8);
+                    e.call(8);
                     return true;
                 }
             },
+
+#define LAZY_VEC(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    return lift_vector(op); \
+                } \
+            }
+
+            LAZY_VEC(ZYDIS_MNEMONIC_MOVDQU, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_MOVDQA, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_MOVUPS, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_MOVAPS, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_VMOVDQU, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_VMOVDQA, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_VMOVUPS, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_VMOVAPS, v0_vec_op::mov),
+            LAZY_VEC(ZYDIS_MNEMONIC_PADDB, v0_vec_op::paddb),
+            LAZY_VEC(ZYDIS_MNEMONIC_PADDW, v0_vec_op::paddw),
+            LAZY_VEC(ZYDIS_MNEMONIC_PADDD, v0_vec_op::paddd),
+            LAZY_VEC(ZYDIS_MNEMONIC_PADDQ, v0_vec_op::paddq),
+            LAZY_VEC(ZYDIS_MNEMONIC_PSUBB, v0_vec_op::psubb),
+            LAZY_VEC(ZYDIS_MNEMONIC_PSUBW, v0_vec_op::psubw),
+            LAZY_VEC(ZYDIS_MNEMONIC_PSUBD, v0_vec_op::psubd),
+            LAZY_VEC(ZYDIS_MNEMONIC_PSUBQ, v0_vec_op::psubq),
+            LAZY_VEC(ZYDIS_MNEMONIC_PAND, v0_vec_op::pand),
+            LAZY_VEC(ZYDIS_MNEMONIC_PANDN, v0_vec_op::pandn),
+            LAZY_VEC(ZYDIS_MNEMONIC_POR, v0_vec_op::por),
+            LAZY_VEC(ZYDIS_MNEMONIC_PXOR, v0_vec_op::pxor),
+            LAZY_VEC(ZYDIS_MNEMONIC_PCMPEQB, v0_vec_op::pcmpeqb),
+            LAZY_VEC(ZYDIS_MNEMONIC_PCMPEQW, v0_vec_op::pcmpeqw),
+            LAZY_VEC(ZYDIS_MNEMONIC_PCMPEQD, v0_vec_op::pcmpeqd),
+            LAZY_VEC(ZYDIS_MNEMONIC_PSHUFB, v0_vec_op::pshufb),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPADDB, v0_vec_op::paddb),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPADDW, v0_vec_op::paddw),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPADDD, v0_vec_op::paddd),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPADDQ, v0_vec_op::paddq),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPSUBB, v0_vec_op::psubb),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPSUBW, v0_vec_op::psubw),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPSUBD, v0_vec_op::psubd),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPSUBQ, v0_vec_op::psubq),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPAND, v0_vec_op::pand),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPANDN, v0_vec_op::pandn),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPOR, v0_vec_op::por),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPXOR, v0_vec_op::pxor),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPCMPEQB, v0_vec_op::pcmpeqb),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPCMPEQW, v0_vec_op::pcmpeqw),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPCMPEQD, v0_vec_op::pcmpeqd),
+            LAZY_VEC(ZYDIS_MNEMONIC_VPSHUFB, v0_vec_op::pshufb),
+#undef LAZY_VEC
+
+#define LAZY_REP(mnemonic, op) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    return lift_string(op, dst.size); \
+                } \
+            }
+
+            LAZY_REP(ZYDIS_MNEMONIC_MOVSB, v0_rep_op::movs),
+            LAZY_REP(ZYDIS_MNEMONIC_MOVSW, v0_rep_op::movs),
+            LAZY_REP(ZYDIS_MNEMONIC_MOVSQ, v0_rep_op::movs),
+            LAZY_REP(ZYDIS_MNEMONIC_STOSB, v0_rep_op::stos),
+            LAZY_REP(ZYDIS_MNEMONIC_STOSW, v0_rep_op::stos),
+            LAZY_REP(ZYDIS_MNEMONIC_STOSD, v0_rep_op::stos),
+            LAZY_REP(ZYDIS_MNEMONIC_STOSQ, v0_rep_op::stos),
+            LAZY_REP(ZYDIS_MNEMONIC_CMPSB, v0_rep_op::cmps),
+            LAZY_REP(ZYDIS_MNEMONIC_CMPSW, v0_rep_op::cmps),
+            LAZY_REP(ZYDIS_MNEMONIC_CMPSD, v0_rep_op::cmps),
+            LAZY_REP(ZYDIS_MNEMONIC_CMPSQ, v0_rep_op::cmps),
+            LAZY_REP(ZYDIS_MNEMONIC_SCASB, v0_rep_op::scas),
+            LAZY_REP(ZYDIS_MNEMONIC_SCASW, v0_rep_op::scas),
+            LAZY_REP(ZYDIS_MNEMONIC_SCASD, v0_rep_op::scas),
+            LAZY_REP(ZYDIS_MNEMONIC_SCASQ, v0_rep_op::scas),
+#undef LAZY_REP
+
+            // `movsd` is both the string move and the sse scalar move
+            //
+            {
+                ZYDIS_MNEMONIC_MOVSD, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) {
+                    if (instruction->info.meta.category == ZYDIS_CATEGORY_STRINGOP)
+                        return lift_string(v0_rep_op::movs, dst.size);
+                    return lift_scalar(v0_fp_op::mov, 8);
+                }
+            },
+
+#define LAZY_FP(mnemonic, op, width) \
+            { \
+                mnemonic, [&](covirt::zydis_operand &dst, covirt::zydis_operand &src) { \
+                    return lift_scalar(op, width); \
+                } \
+            }
+
+            LAZY_FP(ZYDIS_MNEMONIC_MOVSS, v0_fp_op::mov, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_ADDSS, v0_fp_op::add, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_ADDSD, v0_fp_op::add, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_SUBSS, v0_fp_op::sub, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_SUBSD, v0_fp_op::sub, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_MULSS, v0_fp_op::mul, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_MULSD, v0_fp_op::mul, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_DIVSS, v0_fp_op::div, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_DIVSD, v0_fp_op::div, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_MINSS, v0_fp_op::min, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_MINSD, v0_fp_op::min, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_MAXSS, v0_fp_op::max, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_MAXSD, v0_fp_op::max, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_SQRTSS, v0_fp_op::sqrt, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_SQRTSD, v0_fp_op::sqrt, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_UCOMISS, v0_fp_op::ucomi, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_UCOMISD, v0_fp_op::ucomi, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_COMISS, v0_fp_op::comi, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_COMISD, v0_fp_op::comi, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_CVTSI2SS, v0_fp_op::cvtsi2_32, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_CVTSI2SD, v0_fp_op::cvtsi2_32, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_CVTTSS2SI, v0_fp_op::cvtt2si_32, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_CVTTSD2SI, v0_fp_op::cvtt2si_32, 8),
+            LAZY_FP(ZYDIS_MNEMONIC_CVTSS2SD, v0_fp_op::cvts2s, 4),
+            LAZY_FP(ZYDIS_MNEMONIC_CVTSD2SS, v0_fp_op::cvts2s, 8),
+#undef LAZY_FP
         };
     };
 
@@ -157,6 +836,7 @@ namespace covirt::vm {
     public:
         void initialize(zasm::x86::Assembler &a) override;
         void finalize(zasm::x86::Assembler& a) override;
+        void emit_unobfuscated(zasm::x86::Assembler& a) override;
 
         std::map<uint8_t, fn_vm_handler_t>& get_handlers() override { return vm_impl; }
         generic_vm_enter& get_vm_enter() override { return vm_enter_emitter; }
@@ -164,19 +844,41 @@ namespace covirt::vm {
         void set_code_size(size_t size) override { code_size = size; };
         void set_stack_size(size_t size) override { stack_size = size; };
 
+        handler_profile_t& get_expected_profile() override { return expected_profile; }
+
+        // enables the jit tier: a region (given by the bytecode offsets it's entered
+        // at) is translated into native code once it was entered `threshold` times.
+        // translations live in an mmap'd cache of `cache_size` bytes which is
+        // flushed as a whole when the next one doesn't fit. linux only
+        //
+        void set_jit(size_t threshold, size_t cache_size, std::vector<uint32_t> entries, size_t code_length);
+
     private:
         zasm::x86::Gp64 vip, vsp;
 
         size_t code_size = 0;
         size_t stack_size = 0;
 
+        // 0 disables the jit tier
+        //
+        size_t jit_threshold = 0;
+        size_t jit_cache_size = 0;
+
+        // bytecode range [start, end) of every region
+        //
+        std::vector<std::pair<uint32_t, uint32_t>> jit_regions;
+
         std::map<std::string, zasm::Label> global_labels = {
-            {"saved_rsp", {}},
+            {"vcontext", {}},
+            {"vnative_stack", {}},
+            {"vnative_stack_top", {}},
+            {"vcall_target", {}},
             {"_vsp", {}},
             {"_vip", {}},
             {"vstack", {}},
             {"vcode", {}},
             {"vtable", {}},
+            {"vdispatch", {}},
             {"retaddr", {}},
             {"venter", {}},
             {"vexit", {}},
@@ -192,23 +894,130 @@ namespace covirt::vm {
             {"vor", {}},
             {"vcmp", {}},
             {"vjmp", {}},
-            {"vjz", {}},
-            {"vjnz", {}},
-            {"vjb", {}},
-            {"vjnb", {}},
-            {"vjbe", {}},
-            {"vjnbe", {}},
-            {"vjl", {}},
-            {"vjle", {}},
-            {"vjnl", {}},
-            {"vjnle", {}},
+            {"vjcc", {}},
+            {"jcc_table", {}},
             {"vcall", {}},
             {"vlea", {}},
-            {"vexenative", {}}
+            {"vexenative", {}},
+            {"vvec", {}},
+            {"vxmm", {}},
+            {"vxmm_state", {}},
+            {"vrep", {}},
+            {"vrep_scratch", {}},
+            {"vrep_pattern", {}},
+            {"vea", {}},
+            {"vshift", {}},
+            {"vmul", {}},
+            {"vtest", {}},
+            {"vsetcc", {}},
+            {"vcmov", {}},
+            {"vext", {}},
+            {"vspush", {}},
+            {"vspop", {}},
+            {"vret", {}},
+            {"vjmp_table", {}},
+            {"vatomic", {}},
+            {"vbitop", {}},
+            {"varith", {}},
+            {"vfp", {}},
+            {"vdup", {}},
+            {"vswap", {}},
+            {"vover", {}},
+            {"vintrinsic", {}},
+            {"vjit_resume", {}},
+            {"vjit_compile", {}},
+            {"vjit_regions", {}},
+            {"vjit_entries", {}},
+            {"vjit_ops", {}},
+            {"vjit_templates", {}},
+            {"vjit_map", {}},
+            {"vjit_cache", {}},
+            {"vjit_used", {}},
+            {"vjit_seed", {}}
+        };
+
+        std::map<v0_op, std::string> handler_labels = {
+            { v0_op::vm_enter, "venter" },
+            { v0_op::vm_exit, "vexit" },
+            { v0_op::push_imm, "vpush_imm" },
+            { v0_op::push_reg, "vpush_reg" },
+            { v0_op::pop, "vpop" },
+            { v0_op::read, "vread" },
+            { v0_op::write, "vwrite" },
+            { v0_op::add, "vadd" },
+            { v0_op::sub, "vsub" },
+            { v0_op::bxor, "vxor" },
+            { v0_op::band, "vand" },
+            { v0_op::bor, "vor" },
+            { v0_op::cmp, "vcmp" },
+            { v0_op::jmp, "vjmp" },
+            { v0_op::jcc, "vjcc" },
+            { v0_op::call, "vcall" },
+            { v0_op::lea, "vlea" },
+            { v0_op::execute_native, "vexenative" },
+            { v0_op::vec, "vvec" },
+            { v0_op::rep, "vrep" },
+            { v0_op::ea, "vea" },
+            { v0_op::shift, "vshift" },
+            { v0_op::mul, "vmul" },
+            { v0_op::test, "vtest" },
+            { v0_op::setcc, "vsetcc" },
+            { v0_op::cmov, "vcmov" },
+            { v0_op::ext, "vext" },
+            { v0_op::spush, "vspush" },
+            { v0_op::spop, "vspop" },
+            { v0_op::ret, "vret" },
+            { v0_op::jmp_table, "vjmp_table" },
+            { v0_op::atomic, "vatomic" },
+            { v0_op::bitop, "vbitop" },
+            { v0_op::arith, "varith" },
+            { v0_op::fp, "vfp" },
+            { v0_op::dup, "vdup" },
+            { v0_op::swap, "vswap" },
+            { v0_op::over, "vover" },
+            { v0_op::intrinsic, "vintrinsic" },
+            { v0_op::jit_resume, "vjit_resume" }
         };
 
         default_vm_enter vm_enter_emitter;
 
+        // rough static frequencies; operand shuffling dominates lifted code,
+        // transitions in/out of the vm are cold
+        //
+        handler_profile_t expected_profile = {
+            { uint8_t(v0_op::push_reg), 100 },
+            { uint8_t(v0_op::pop), 90 },
+            { uint8_t(v0_op::push_imm), 80 },
+            { uint8_t(v0_op::add), 70 },
+            { uint8_t(v0_op::read), 60 },
+            { uint8_t(v0_op::write), 50 },
+            { uint8_t(v0_op::cmp), 45 },
+            { uint8_t(v0_op::test), 42 },
+            { uint8_t(v0_op::jcc), 40 },
+            { uint8_t(v0_op::jmp), 35 },
+            { uint8_t(v0_op::ext), 32 },
+            { uint8_t(v0_op::spush), 31 },
+            { uint8_t(v0_op::spop), 31 },
+            { uint8_t(v0_op::sub), 30 },
+            { uint8_t(v0_op::bxor), 25 },
+            { uint8_t(v0_op::band), 20 },
+            { uint8_t(v0_op::bor), 15 },
+            { uint8_t(v0_op::shift), 12 },
+            { uint8_t(v0_op::mul), 11 },
+            { uint8_t(v0_op::setcc), 10 },
+            { uint8_t(v0_op::cmov), 10 },
+            { uint8_t(v0_op::ea), 65 },
+            { uint8_t(v0_op::vec), 10 },
+            { uint8_t(v0_op::atomic), 5 },
+            { uint8_t(v0_op::bitop), 8 },
+            { uint8_t(v0_op::arith), 38 },
+            { uint8_t(v0_op::fp), 10 },
+            { uint8_t(v0_op::dup), 28 },
+            { uint8_t(v0_op::swap), 4 },
+            { uint8_t(v0_op::over), 4 },
+            { uint8_t(v0_op::intrinsic), 6 },
+        };
+
         // to-do: look into `embedLabelRel` instead of runtime creation? idk
         //
         template <typename T, typename... Tx>
@@ -229,87 +1038,205 @@ namespace covirt::vm {
             a.bind(pass);
         }
 
-        void vm_next_instruction(zasm::x86::Assembler& a, std::optional<zasm::Label> label = {});
-        void jump_using_table(zasm::x86::Assembler& a, zasm::Label &paths);
-        void get_size_from_opcode(zasm::x86::Assembler& a, zasm::Label &start);
-        void get_vreg_address(zasm::x86::Assembler& a);
-        void get_vreg_value(zasm::x86::Assembler& a);
-
-        std::map<uint8_t, fn_vm_handler_t> vm_impl = {
-            {
-                uint8_t(v0_op::vm_enter), [&](zasm::x86::Assembler& a) {
-                    a.bind(global_labels["venter"]);
+        template <typename T, size_t N>
+        void create_jump_table_once(zasm::x86::Assembler& a, T table, std::array<zasm::Label, N>& entries)
+        {
+            auto pass = a.createLabel();
 
-                    a.pop(zasm::x86::r11);
-                    a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]), zasm::x86::r11);
-                    a.pop(zasm::x86::r11);
-                    a.add(zasm::x86::rsp, 0x200);
-                    a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["saved_rsp"]), zasm::x86::rsp);
-
-                    // to-do: save r9, r10 before?
-                    // to-do: not ideal, this is repetitive
-
-                    create_jump_table_once(a, global_labels["vtable"], global_labels["venter"], global_labels["vexit"], 
-                            global_labels["vpush_imm"], global_labels["vpush_reg"], global_labels["vpop"], global_labels["vread"], global_labels["vwrite"], 
-                            global_labels["vadd"], global_labels["vsub"], global_labels["vxor"], global_labels["vand"], global_labels["vor"], 
-                            global_labels["vcmp"], global_labels["vjmp"], global_labels["vjz"], global_labels["vjnz"], global_labels["vjb"], 
-                            global_labels["vjnb"], global_labels["vjbe"], global_labels["vjnbe"], global_labels["vjl"], global_labels["vjle"],
-                            global_labels["vjnl"], global_labels["vjnle"], global_labels["vcall"], global_labels["vlea"], global_labels["vexenative"]);
-
-                    a.push(zasm::x86::r15); // -8
-                    a.push(zasm::x86::r14); // -16
-                    a.push(zasm::x86::r13); // -24
-                    a.push(zasm::x86::r12); // -32
-                    a.push(zasm::x86::r11); // -40
-                    a.push(zasm::x86::r10); // -48
-                    a.push(zasm::x86::r9); // -56
-                    a.push(zasm::x86::r8); // -64
-                    a.push(zasm::x86::rdi); // -72
-                    a.push(zasm::x86::rsi); // -80
-                    a.push(zasm::x86::rbp); // -88
-                    a.push(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["saved_rsp"])); // -96 v4!=real_rsp,so xx not xxx
-                    a.push(zasm::x86::rbx); // -104
-                    a.push(zasm::x86::rdx); // -112 v2
-                    a.push(zasm::x86::rcx); // -120 v1 
-                    a.push(zasm::x86::rax); // -128 v0
-                    a.pushfq(); // -136
+            a.cmp(zasm::x86::qword_ptr(zasm::x86::rip, table), 0);
+            a.jnz(pass);
+
+            a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, table));
+            for (auto& label : entries) {
+                a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, label));
+                a.mov(zasm::x86::qword_ptr(zasm::x86::r9), zasm::x86::r10);
+                a.add(zasm::x86::r9, 8);
+            }
+
+            a.bind(pass);
+        }
+
+        // fills `vtable` with the entry points of every assembled handler,
+        // unused opcodes are left as null
+        //
+        void create_vtable_once(zasm::x86::Assembler& a);
+
+        // size variants which the bytecode never uses are replaced with a trap,
+        // returns true if the caller should not emit the variant
+        //
+        bool skip_variant(zasm::x86::Assembler& a, v0_op opcode, int size_bits);
+
+        // sets CF to whether condition `rcx` (x86 condition nibble) holds for the
+        // flags word in `rdx`, using `jcc_table` (or `table` holding its address);
+        // clobbers rdx, r9, r10
+        //
+        void test_condition(zasm::x86::Assembler& a, std::optional<zasm::x86::Gp64> table = {});
+
+        // loads the vm flags into rdx for `test_condition`, clobbers r9
+        //
+        void load_vflags(zasm::x86::Assembler& a);
+
+        // CF, PF, AF, ZF, SF, OF
+        //
+        static constexpr uint32_t arith_flags = 0x8d5;
+
+        // the guest's rflags (slot 17 of `vcontext`) double as the vm's flags,
+        // lifted instructions update them and `jcc` reads them
+        //
+        static constexpr int32_t vflags_offset = 17 * 8;
+
+        // bytes of private stack the handlers push to, so a lifted push/pop can
+        // move the guest rsp without running into the saved context
+        //
+        static constexpr size_t native_stack_size = 0x1000;
+
+        // stores the guest registers (v0-v15 by x86 index), then rflags into `vcontext`
+        // and switches rsp to the private stack; clobbers rax
+        //
+        void save_context(zasm::x86::Assembler& a);
+
+        // inverse of `save_context`, leaves rsp at the guest's stack pointer
+        //
+        void load_context(zasm::x86::Assembler& a);
+
+        // restores the guest and jumps to `retaddr`
+        //
+        void exit_vm(zasm::x86::Assembler& a);
+
+        // merges the `mask` bits of `flags` into the guest rflags, clobbers `flags`, r9
+        //
+        void store_vflags(zasm::x86::Assembler& a, zasm::x86::Gp64 flags, uint32_t mask = arith_flags);
+
+        // the guest's xmm/ymm registers are copied into `vxmm` the first time a `vec`
+        // handler needs them, `vxmm_state` records how much was copied (0 none,
+        // 1 the low 128 bits, 2 all 256); expects the width needed in cl, clobbers r9
+        //
+        void spill_vector_state(zasm::x86::Assembler& a);
+
+        // loads `vxmm` back into the real registers before leaving the vm,
+        // clobbers rcx, r9 and flags
+        //
+        void restore_vector_state(zasm::x86::Assembler& a);
+
+        // raw encoding of a (rep/repe/repne) string instruction, zasm has no
+        // convenient way of emitting the prefixed forms
+        //
+        void emit_string_instruction(zasm::x86::Assembler& a, v0_rep_op op, bool ne, int size_bits);
+
+        // raw encoding of `lock <op> [r10], r11` at the given size (cmpxchg also uses
+        // the accumulator, inc/dec only take [r10]), so no pass can rewrite it
+        // apart from its prefix
+        //
+        void emit_locked_instruction(zasm::x86::Assembler& a, v0_atomic_op op, int size_bits);
+
+        // the vstack entry of the given size bits at byte offset `disp` from vsp,
+        // or from `base` for the jit templates which address other memory too
+        //
+        zasm::x86::Mem stack_slot(int size_bits, int32_t disp);
+        static zasm::x86::Mem stack_slot(int size_bits, zasm::x86::Gp64 base, int32_t disp = 0);
+
+        // bytes per region in `vjit_regions`: start, end, entry count (u32 each, one
+        // spare), then the translation's entry point or 0
+        //
+        static constexpr int32_t jit_region_size = 32;
+
+        // bytes per raw opcode in `vjit_ops`: template offset (u16), template length,
+        // flags, fixed instruction length, a spare byte, then four holes of (offset
+        // into the template, kind << 4 | operand)
+        //
+        static constexpr int32_t jit_descriptor_size = 16;
+
+        // descriptor flags: the translation calls the interpreter's handler and
+        // resumes after it, the instruction is longer by its first operand byte
+        // (`execute_native`) or twice its first operand word (`jmp_table`)
+        //
+        static constexpr uint8_t jit_callout = 1;
+        static constexpr uint8_t jit_byte_length = 2;
+        static constexpr uint8_t jit_word_length = 4;
+
+        // translated code keeps rbx = `vcontext`, r12 = `jcc_table`, r13 = `vtable`
+        // and r14 = `vcode`, handlers clobber them so they're set again on every
+        // way back into the cache
+        //
+        void pin_jit_registers(zasm::x86::Assembler& a);
+
+        // looks up the region being entered, counts the entry and runs (or first
+        // translates) its native code once it's hot, falls through to the
+        // interpreter otherwise
+        //
+        void enter_jit(zasm::x86::Assembler& a);
+
+        // `vjit_compile`: translates the region at r9 and returns its entry point
+        // in r10 (0 on failure); preserves vip and vsp. every translation is laid
+        // out with fresh random padding and junk between the instructions. it's
+        // emitted through `emit_unobfuscated`, as the passes would clobber the
+        // registers it keeps values in
+        //
+        void emit_jit_compiler(zasm::x86::Assembler& a);
+
+        // the `vjit_ops` descriptors and the `vjit_templates` they point into,
+        // assembled apart from the vm so no obfuscation pass moves the holes
+        //
+        std::pair<std::vector<uint8_t>, std::vector<uint8_t>> assemble_jit_templates();
+
+        void vm_next_instruction(zasm::x86::Assembler& a, std::optional<zasm::Label> label = {});
+        void jump_using_table(zasm::x86::Assembler& a, zasm::Label &paths, size_t count = 4);
+        void get_size_from_opcode(zasm::x86::Assembler& a, zasm::Label &start);
+        void get_vreg_address(zasm::x86::Assembler& a);
+        void get_vreg_value(zasm::x86::Assembler& a);
+
+        std::map<uint8_t, fn_vm_handler_t> vm_impl = {
+            {
+                uint8_t(v0_op::vm_enter), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["venter"]);
+
+                    // keep r11 and the flags intact for the context
+                    //
+                    a.pop(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]));
+                    a.pop(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vip"]));
+                    a.lea(zasm::x86::rsp, zasm::x86::qword_ptr(zasm::x86::rsp, 0x200));
+
+                    save_context(a);
+                    create_vtable_once(a);
 
                     a.lea(vsp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vstack"]));
                     a.add(vsp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]));
                     a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::r11);
+                    a.add(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vip"]));
+
+                    if (jit_threshold)
+                        enter_jit(a);
+
+                    // the dispatch shared by handlers which don't have their own
+                    //
+                    a.bind(global_labels["vdispatch"]);
                     vm_next_instruction(a);
                 }
             },
             {
                 uint8_t(v0_op::vm_exit), [&](zasm::x86::Assembler& a) {
-                    a.bind(global_labels["vexit"]);
+                    auto indirect = a.createLabel();
+                    auto target_known = a.createLabel();
 
-                    a.add(vip, 1);
-                    a.mov(zasm::x86::r10w, zasm::x86::word_ptr(vip));
-                    a.add(zasm::x86::word_ptr(zasm::x86::rip, global_labels["retaddr"]), zasm::x86::r10w);
+                    // the 1 byte variant carries the continuation relative to the retaddr,
+                    // the end of the region or the target of a jump leaving it. the 8 byte
+                    // variant pops the absolute target of an indirect jump
+                    //
+                    get_size_from_opcode(a, global_labels["vexit"]);
+                    a.cmp(zasm::x86::ecx, 0b11);
+                    a.je(indirect);
 
-                    a.popfq();
-                    a.pop(zasm::x86::rax);
-                    a.pop(zasm::x86::rcx);
-                    a.pop(zasm::x86::rdx);
-                    a.pop(zasm::x86::rbx);
-                    a.pop(zasm::x86::rbp); // rsp
-                    a.pop(zasm::x86::rbp);
-                    a.pop(zasm::x86::rsi);
-                    a.pop(zasm::x86::rdi);
-                    a.pop(zasm::x86::r8);
-                    a.pop(zasm::x86::r9);
-                    a.pop(zasm::x86::r10);
-                    a.pop(zasm::x86::r11);
-                    a.pop(zasm::x86::r12);
-                    a.pop(zasm::x86::r13);
-                    a.pop(zasm::x86::r14);
-                    a.pop(zasm::x86::r15);
+                    a.movsxd(zasm::x86::r10, zasm::x86::dword_ptr(vip));
+                    a.add(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]), zasm::x86::r10);
+                    a.jmp(target_known);
 
-                    vm_enter_emitter.revert_effects(a);
+                    a.bind(indirect);
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(vsp));
+                    a.add(vsp, 8);
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]), zasm::x86::r10);
 
-                    a.jmp(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]));
+                    a.bind(target_known);
+                    exit_vm(a);
                 }
             },
             {
@@ -318,6 +1245,7 @@ namespace covirt::vm {
 
                     auto vpushz = [&]<typename T>(int size, zasm::x86::Gp v, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::push_imm, size)) return;
                         a.sub(vsp, 1 << size);
                         a.mov(v, ptr(std::forward<zasm::x86::Gp64>(vip)));
                         a.mov(ptr(std::forward<zasm::x86::Gp64>(vsp)), v);
@@ -344,6 +1272,7 @@ namespace covirt::vm {
 
                     auto vpushz = [&]<typename T>(int size, zasm::x86::Gp v, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::push_reg, size)) return;
                         a.sub(vsp, 1 << size);
                         a.mov(ptr(std::forward<zasm::x86::Gp64>(vsp)), v);
                         a.jmp(labels[5]);
@@ -369,9 +1298,16 @@ namespace covirt::vm {
 
                     auto vpopz = [&]<typename T>(int size, zasm::x86::Gp v, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::pop, size)) return;
                         a.mov(v, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.add(vsp, 1 << size);
-                        a.mov(ptr(const_cast<zasm::x86::Gp64&&>(zasm::x86::rdx)), v);
+
+                        // writing a 32-bit register clears the upper half
+                        //
+                        if (size == 0b10)
+                            a.mov(zasm::x86::qword_ptr(zasm::x86::rdx), v.r64());
+                        else
+                            a.mov(ptr(const_cast<zasm::x86::Gp64&&>(zasm::x86::rdx)), v);
                         a.jmp(labels[5]);
                     };
 
@@ -395,6 +1331,7 @@ namespace covirt::vm {
 
                     auto vreadz = [&]<typename T>(int size, zasm::x86::Gp v, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::read, size)) return;
                         a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(vsp));
                         a.add(vsp, 8 - (1 << size));
                         a.mov(v, ptr(const_cast<zasm::x86::Gp64&&>(zasm::x86::rdx)));
@@ -421,6 +1358,7 @@ namespace covirt::vm {
 
                     auto vwritez = [&]<typename T>(int size, zasm::x86::Gp v, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::write, size)) return;
                         a.mov(zasm::x86::r10, zasm::x86::qword_ptr(vsp));
                         a.mov(ptr(const_cast<zasm::x86::Gp64&&>(zasm::x86::r10)), v);
                         a.add(vsp, 8);
@@ -447,6 +1385,7 @@ namespace covirt::vm {
 
                     auto varith = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::add, size)) return;
                         a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.add(vsp, 1 << size);
                         a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
@@ -474,6 +1413,7 @@ namespace covirt::vm {
 
                     auto varith = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::sub, size)) return;
                         a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.add(vsp, 1 << size);
                         a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
@@ -501,6 +1441,7 @@ namespace covirt::vm {
 
                     auto varith = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::bxor, size)) return;
                         a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.add(vsp, 1 << size);
                         a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
@@ -528,6 +1469,7 @@ namespace covirt::vm {
 
                     auto varith = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::band, size)) return;
                         a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.add(vsp, 1 << size);
                         a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
@@ -555,6 +1497,7 @@ namespace covirt::vm {
 
                     auto varith = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::bor, size)) return;
                         a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.add(vsp, 1 << size);
                         a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
@@ -582,15 +1525,15 @@ namespace covirt::vm {
 
                     auto varith = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
                         a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::cmp, size)) return;
                         a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.add(vsp, 1 << size);
                         a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
                         a.cmp(v1, v0);
                         a.pushfq();
-                        a.pop(v0.r64());
+                        a.pop(zasm::x86::r11);
                         a.add(vsp, 1 << size);
-                        a.sub(vsp, 2);
-                        a.mov(zasm::x86::word_ptr(std::forward<zasm::x86::Gp64>(vsp)), v0.r16());
+                        store_vflags(a, zasm::x86::r11);
                         a.jmp(labels[5]);
                     };
 
@@ -608,266 +1551,90 @@ namespace covirt::vm {
                 }
             },
             {
-                uint8_t(v0_op::jmp), [&](zasm::x86::Assembler& a) {
-                    a.bind(global_labels["vjmp"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jz), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
-
-                    a.bind(global_labels["vjz"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // ZF = 1?
-                    a.and_(zasm::x86::rdx, 0x0040);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jnz), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
+                uint8_t(v0_op::test), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
 
-                    a.bind(global_labels["vjnz"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // ZF = 0?
-                    a.and_(zasm::x86::rdx, 0x0040);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jb), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
+                    auto varith = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::test, size)) return;
+                        a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        a.add(vsp, 1 << size);
+                        a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        a.test(v1, v0);
+                        a.pushfq();
+                        a.pop(zasm::x86::r11);
+                        a.add(vsp, 1 << size);
+                        store_vflags(a, zasm::x86::r11);
+                        a.jmp(labels[5]);
+                    };
 
-                    a.bind(global_labels["vjb"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // CF = 1?
-                    a.and_(zasm::x86::rdx, 0x0001);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jnb), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
+                    get_size_from_opcode(a, global_labels["vtest"]);
 
-                    a.bind(global_labels["vjnb"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // CF = 0?
-                    a.and_(zasm::x86::rdx, 0x0001);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jbe), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
 
-                    a.bind(global_labels["vjbe"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // CF = 1?
-                    a.and_(zasm::x86::rdx, 0x0001);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(truth);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // or ZF = 1?
-                    a.and_(zasm::x86::rdx, 0x0040);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jnbe), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel(), ntruth = a.createLabel();
+                    varith(0b00, zasm::x86::cl, zasm::x86::dl, zasm::x86::byte_ptr<zasm::x86::Gp64>);
+                    varith(0b01, zasm::x86::cx, zasm::x86::dx, zasm::x86::word_ptr<zasm::x86::Gp64>);
+                    varith(0b10, zasm::x86::ecx, zasm::x86::edx, zasm::x86::dword_ptr<zasm::x86::Gp64>);
+                    varith(0b11, zasm::x86::rcx, zasm::x86::rdx, zasm::x86::qword_ptr<zasm::x86::Gp64>);
 
-                    a.bind(global_labels["vjnbe"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // CF = 0?
-                    a.and_(zasm::x86::rdx, 0x0001);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(ntruth);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // and ZF = 0?
-                    a.and_(zasm::x86::rdx, 0x0040);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(ntruth);
-                    a.jmp(truth);
-                    a.bind(ntruth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
+                    vm_next_instruction(a, labels[5]);
                 }
             },
             {
-                uint8_t(v0_op::jl), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
-
-                    a.bind(global_labels["vjl"]);
+                uint8_t(v0_op::jmp), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["vjmp"]);
                     a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // or SF != OF?
-                    a.and_(zasm::x86::rdx, 0x0880);
-                    a.popcnt(zasm::x86::rdx, zasm::x86::rdx);
-                    a.cmp(zasm::x86::rdx, 1);
-                    a.jz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
                     a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
                     a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
                     a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
                     vm_next_instruction(a);
                 }
             },
             {
-                uint8_t(v0_op::jle), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
-
-                    a.bind(global_labels["vjle"]);
+                uint8_t(v0_op::jcc), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["vjcc"]);
                     a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // ZF = 1?
-                    a.and_(zasm::x86::rdx, 0x0040);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(truth);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // or SF != OF?
-                    a.and_(zasm::x86::rdx, 0x0880);
-                    a.popcnt(zasm::x86::rdx, zasm::x86::rdx);
-                    a.cmp(zasm::x86::rdx, 1);
-                    a.jz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jnl), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel();
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip)); // condition
+                    load_vflags(a);
 
-                    a.bind(global_labels["vjnl"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // or SF == OF?
-                    a.and_(zasm::x86::rdx, 0x0880);
-                    a.popcnt(zasm::x86::rdx, zasm::x86::rdx);
-                    a.cmp(zasm::x86::rdx, 1);
-                    a.jnz(truth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
-                    vm_next_instruction(a);
-                }
-            },
-            {
-                uint8_t(v0_op::jnle), [&](zasm::x86::Assembler& a) {
-                    auto vnext = a.createLabel(), truth = a.createLabel(), ntruth = a.createLabel();
+                    test_condition(a);
 
-                    a.bind(global_labels["vjnle"]);
-                    a.add(vip, 1);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // ZF = 0?
-                    a.and_(zasm::x86::rdx, 0x0040);
-                    a.test(zasm::x86::rdx, zasm::x86::rdx);
-                    a.jnz(ntruth);
-                    a.movzx(zasm::x86::rdx, zasm::x86::word_ptr(vsp)); // and SF == OF?
-                    a.and_(zasm::x86::rdx, 0x0880);
-                    a.popcnt(zasm::x86::rdx, zasm::x86::rdx);
-                    a.cmp(zasm::x86::rdx, 1);
-                    a.jz(ntruth);
-                    a.jmp(truth);
-                    a.bind(ntruth);
-                    a.add(vip, 2);
-                    a.jmp(vnext);
-                    
-                    a.bind(truth);
-                    a.movzx(zasm::x86::rcx, zasm::x86::word_ptr(vip));
-                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
-                    a.add(vip, zasm::x86::rcx);
-                    a.bind(vnext);
-                    a.add(vsp, 2);
+                    // taken: vcode + target, otherwise skip the condition and target.
+                    // only flag preserving instructions until the cmovb reads CF
+                    //
+                    a.movzx(zasm::x86::ecx, zasm::x86::word_ptr(vip, 1));
+                    a.lea(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
+                    a.lea(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::rdx, zasm::x86::rcx));
+                    a.lea(vip, zasm::x86::qword_ptr(vip, 3));
+                    a.cmovb(vip, zasm::x86::rdx);
                     vm_next_instruction(a);
                 }
             },
             {
                 uint8_t(v0_op::call), [&](zasm::x86::Assembler& a) {
-                    a.bind(global_labels["vcall"]);
-                    a.add(vip, 1);
+                    auto indirect = a.createLabel();
+                    auto target_known = a.createLabel();
+
+                    // the 1 byte variant carries an rva relative to retaddr, the 8 byte
+                    // variant pops an absolute target
+                    //
+                    get_size_from_opcode(a, global_labels["vcall"]);
+                    a.cmp(zasm::x86::ecx, 0b11);
+                    a.je(indirect);
+
                     a.mov(zasm::x86::r11, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]));
                     a.movsxd(zasm::x86::r9, zasm::x86::dword_ptr(vip));
                     a.add(zasm::x86::r11, zasm::x86::r9);
+                    a.add(vip, 4);
+                    a.jmp(target_known);
+
+                    a.bind(indirect);
+                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(vsp));
+                    a.add(vsp, 8);
+
+                    a.bind(target_known);
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcall_target"]), zasm::x86::r11);
 
                     // push original global_labels["retaddr"] to global_labels["vstack"], incase we vmenter somewhere else
                     a.sub(vsp, 8);
@@ -875,7 +1642,6 @@ namespace covirt::vm {
                     a.mov(zasm::x86::qword_ptr(vsp), zasm::x86::r9);
 
                     // push current vip to global_labels["vstack"], in case we vmenter somewhere else
-                    a.add(vip, 4);
                     a.sub(vsp, 8);
                     a.mov(zasm::x86::qword_ptr(vsp), vip);
 
@@ -885,56 +1651,31 @@ namespace covirt::vm {
                     a.sub(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]), zasm::x86::r9);
 
                     // vmexit proc
-                    a.popfq();
-                    a.pop(zasm::x86::rax);
-                    a.pop(zasm::x86::rcx);
-                    a.pop(zasm::x86::rdx);
-                    a.pop(zasm::x86::rbx);
-                    a.pop(zasm::x86::rbp); // rsp
-                    a.pop(zasm::x86::rbp);
-                    a.pop(zasm::x86::rsi);
-                    a.pop(zasm::x86::rdi);
-                    a.pop(zasm::x86::r8);
-                    a.pop(zasm::x86::r9);
-                    a.pop(zasm::x86::r10);
-                    a.pop(zasm::x86::r12); // r11
-                    a.pop(zasm::x86::r12);
-                    a.pop(zasm::x86::r13);
-                    a.pop(zasm::x86::r14);
-                    a.pop(zasm::x86::r15);
+                    restore_vector_state(a);
+                    load_context(a);
 
                     vm_enter_emitter.revert_effects(a);
 
-                    a.call(zasm::x86::r11);
+                    a.call(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcall_target"]));
 
                     // vmenter proc
                     vm_enter_emitter.assemble_effects(a);
 
-                    a.push(zasm::x86::r15); // -8
-                    a.push(zasm::x86::r14); // -16
-                    a.push(zasm::x86::r13); // -24
-                    a.push(zasm::x86::r12); // -32
-                    a.push(zasm::x86::r11); // -40
-                    a.push(zasm::x86::r10); // -48
-                    a.push(zasm::x86::r9); // -56
-                    a.push(zasm::x86::r8); // -64
-                    a.push(zasm::x86::rdi); // -72
-                    a.push(zasm::x86::rsi); // -80
-                    a.push(zasm::x86::rbp); // -88
-                    a.push(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["saved_rsp"])); // -96
-                    a.push(zasm::x86::rbx); // -104
-                    a.push(zasm::x86::rdx); // -112
-                    a.push(zasm::x86::rcx); // -120
-                    a.push(zasm::x86::rax); // -128
-                    a.pushfq(); // -136
+                    save_context(a);
 
                     a.lea(vsp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vstack"]));
                     a.add(vsp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]));
 
                     a.mov(vip, zasm::x86::qword_ptr(vsp));
-                    a.add(vsp, 8);
-                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(vsp));
+                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(vsp, 8));
                     a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]), zasm::x86::r11);
+                    a.add(vsp, 16);
+
+                    // hand the slots back, the callee may enter the vm again before we do
+                    //
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]), vsp);
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vstack"]));
+                    a.sub(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]), zasm::x86::r9);
 
                     vm_next_instruction(a);
                 }
@@ -987,24 +1728,8 @@ namespace covirt::vm {
                     a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vstack"]));
                     a.sub(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]), zasm::x86::r9);
 
-                    a.popfq();
-                    a.pop(zasm::x86::rax);
-                    a.pop(zasm::x86::rcx);
-                    a.pop(zasm::x86::rdx);
-                    a.pop(zasm::x86::rbx);
-                    a.pop(zasm::x86::rbp); // rsp
-                    a.pop(zasm::x86::rbp);
-                    a.pop(zasm::x86::rsi);
-                    a.pop(zasm::x86::rdi);
-                    a.pop(zasm::x86::r8);
-                    a.pop(zasm::x86::r9);
-                    a.pop(zasm::x86::r10);
-                    a.pop(zasm::x86::r12); // r11
-                    a.pop(zasm::x86::r12);
-                    a.pop(zasm::x86::r13);
-                    a.pop(zasm::x86::r14);
-                    a.pop(zasm::x86::r15);
-                    
+                    restore_vector_state(a);
+                    load_context(a);
 
                     vm_enter_emitter.revert_effects(a);
 
@@ -1014,29 +1739,14 @@ namespace covirt::vm {
 
                     vm_enter_emitter.assemble_effects(a);
 
-                    a.push(zasm::x86::r15); // -8
-                    a.push(zasm::x86::r14); // -16
-                    a.push(zasm::x86::r13); // -24
-                    a.push(zasm::x86::r12); // -32
-                    a.push(zasm::x86::r11); // -40
-                    a.push(zasm::x86::r10); // -48
-                    a.push(zasm::x86::r9); // -56
-                    a.push(zasm::x86::r8); // -64
-                    a.push(zasm::x86::rdi); // -72
-                    a.push(zasm::x86::rsi); // -80
-                    a.push(zasm::x86::rbp); // -88
-                    a.push(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["saved_rsp"])); // -96
-                    a.push(zasm::x86::rbx); // -104
-                    a.push(zasm::x86::rdx); // -112
-                    a.push(zasm::x86::rcx); // -120
-                    a.push(zasm::x86::rax); // -128
-                    a.pushfq(); // -136
+                    save_context(a);
 
                     a.lea(vsp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vstack"]));
                     a.add(vsp, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]));
 
                     a.mov(vip, zasm::x86::qword_ptr(vsp));
                     a.add(vsp, 8);
+                    a.add(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["_vsp"]), 8);
 
                     a.lea(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::rip, native_code_section));
                     a.mov(zasm::x86::dword_ptr(zasm::x86::rdx), 0x90909090);
@@ -1046,6 +1756,1450 @@ namespace covirt::vm {
 
                     vm_next_instruction(a);
                 }
+            },
+            {
+                uint8_t(v0_op::vec), [&](zasm::x86::Assembler& a) {
+                    constexpr auto kinds = size_t(v0_vec_op::pshufb) + 1;
+
+                    auto paths = a.createLabel();
+                    auto trap = a.createLabel();
+                    auto next = a.createLabel();
+                    auto src2_from_stack = a.createLabel();
+                    auto src2_ready = a.createLabel();
+
+                    // one path per kind and width, kinds without an implementation trap
+                    //
+                    std::array<zasm::Label, 2 * vec_ymm> labels;
+                    for (size_t i = 0; i < labels.size(); i++)
+                        labels[i] = (i & ~size_t(vec_ymm)) < kinds ? a.createLabel() : trap;
+
+                    a.bind(global_labels["vvec"]);
+                    a.add(vip, 1);
+
+                    create_jump_table_once(a, paths, labels);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip));
+                    a.shr(zasm::x86::ecx, 5);
+                    a.add(zasm::x86::ecx, 1);
+                    spill_vector_state(a);
+
+                    // r10 = dst, rdx = src1, r11 = src2
+                    //
+                    a.movzx(zasm::x86::r10d, zasm::x86::byte_ptr(vip, 1));
+                    a.shl(zasm::x86::r10d, 5);
+                    a.add(zasm::x86::r10, zasm::x86::r9);
+                    a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip, 2));
+                    a.shl(zasm::x86::edx, 5);
+                    a.add(zasm::x86::rdx, zasm::x86::r9);
+                    a.movzx(zasm::x86::r11d, zasm::x86::byte_ptr(vip, 3));
+                    a.cmp(zasm::x86::r11d, vec_memory);
+                    a.je(src2_from_stack);
+                    a.shl(zasm::x86::r11d, 5);
+                    a.add(zasm::x86::r11, zasm::x86::r9);
+                    a.jmp(src2_ready);
+                    a.bind(src2_from_stack);
+                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(vsp));
+                    a.add(vsp, 8);
+                    a.bind(src2_ready);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip));
+                    jump_using_table(a, paths, labels.size());
+
+                    auto emit_kind = [&](v0_vec_op op, zasm::x86::Mnemonic sse, zasm::x86::Mnemonic avx) {
+                        for (auto ymm : { false, true }) {
+                            a.bind(labels[uint8_t(op) | (ymm ? vec_ymm : 0)]);
+
+                            if (!ymm) {
+                                a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::rdx));
+                                a.movdqu(zasm::x86::xmm1, zasm::x86::xmmword_ptr(zasm::x86::r11));
+                                a.emit(sse, zasm::x86::xmm0, zasm::x86::xmm1);
+                                a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                            }
+                            else {
+                                a.vmovdqu(zasm::x86::ymm0, zasm::x86::ymmword_ptr(zasm::x86::rdx));
+                                a.vmovdqu(zasm::x86::ymm1, zasm::x86::ymmword_ptr(zasm::x86::r11));
+                                a.emit(avx, zasm::x86::ymm0, zasm::x86::ymm0, zasm::x86::ymm1);
+                                a.vmovdqu(zasm::x86::ymmword_ptr(zasm::x86::r10), zasm::x86::ymm0);
+                            }
+                            a.jmp(next);
+                        }
+                    };
+
+                    a.bind(trap);
+                    a.ud2();
+
+                    // mov: dst = src2, store: [src2] = src1
+                    //
+                    a.bind(labels[uint8_t(v0_vec_op::mov)]);
+                    a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r11));
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                    a.jmp(next);
+
+                    a.bind(labels[uint8_t(v0_vec_op::mov) | vec_ymm]);
+                    a.vmovdqu(zasm::x86::ymm0, zasm::x86::ymmword_ptr(zasm::x86::r11));
+                    a.vmovdqu(zasm::x86::ymmword_ptr(zasm::x86::r10), zasm::x86::ymm0);
+                    a.jmp(next);
+
+                    a.bind(labels[uint8_t(v0_vec_op::store)]);
+                    a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::rdx));
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r11), zasm::x86::xmm0);
+                    a.jmp(next);
+
+                    a.bind(labels[uint8_t(v0_vec_op::store) | vec_ymm]);
+                    a.vmovdqu(zasm::x86::ymm0, zasm::x86::ymmword_ptr(zasm::x86::rdx));
+                    a.vmovdqu(zasm::x86::ymmword_ptr(zasm::x86::r11), zasm::x86::ymm0);
+                    a.jmp(next);
+
+                    emit_kind(v0_vec_op::paddb, zasm::x86::Mnemonic::Paddb, zasm::x86::Mnemonic::Vpaddb);
+                    emit_kind(v0_vec_op::paddw, zasm::x86::Mnemonic::Paddw, zasm::x86::Mnemonic::Vpaddw);
+                    emit_kind(v0_vec_op::paddd, zasm::x86::Mnemonic::Paddd, zasm::x86::Mnemonic::Vpaddd);
+                    emit_kind(v0_vec_op::paddq, zasm::x86::Mnemonic::Paddq, zasm::x86::Mnemonic::Vpaddq);
+                    emit_kind(v0_vec_op::psubb, zasm::x86::Mnemonic::Psubb, zasm::x86::Mnemonic::Vpsubb);
+                    emit_kind(v0_vec_op::psubw, zasm::x86::Mnemonic::Psubw, zasm::x86::Mnemonic::Vpsubw);
+                    emit_kind(v0_vec_op::psubd, zasm::x86::Mnemonic::Psubd, zasm::x86::Mnemonic::Vpsubd);
+                    emit_kind(v0_vec_op::psubq, zasm::x86::Mnemonic::Psubq, zasm::x86::Mnemonic::Vpsubq);
+                    emit_kind(v0_vec_op::pand, zasm::x86::Mnemonic::Pand, zasm::x86::Mnemonic::Vpand);
+                    emit_kind(v0_vec_op::pandn, zasm::x86::Mnemonic::Pandn, zasm::x86::Mnemonic::Vpandn);
+                    emit_kind(v0_vec_op::por, zasm::x86::Mnemonic::Por, zasm::x86::Mnemonic::Vpor);
+                    emit_kind(v0_vec_op::pxor, zasm::x86::Mnemonic::Pxor, zasm::x86::Mnemonic::Vpxor);
+                    emit_kind(v0_vec_op::pcmpeqb, zasm::x86::Mnemonic::Pcmpeqb, zasm::x86::Mnemonic::Vpcmpeqb);
+                    emit_kind(v0_vec_op::pcmpeqw, zasm::x86::Mnemonic::Pcmpeqw, zasm::x86::Mnemonic::Vpcmpeqw);
+                    emit_kind(v0_vec_op::pcmpeqd, zasm::x86::Mnemonic::Pcmpeqd, zasm::x86::Mnemonic::Vpcmpeqd);
+                    emit_kind(v0_vec_op::pshufb, zasm::x86::Mnemonic::Pshufb, zasm::x86::Mnemonic::Vpshufb);
+
+                    // kind, dst, src1, src2
+                    //
+                    a.bind(next);
+                    a.add(vip, 4);
+                    vm_next_instruction(a);
+                }
+            },
+            {
+                uint8_t(v0_op::rep), [&](zasm::x86::Assembler& a) {
+                    auto native_paths = a.createLabel();
+                    auto native = a.createLabel();
+                    auto native_done = a.createLabel();
+                    auto trap = a.createLabel();
+                    auto stos = a.createLabel();
+                    auto copy = a.createLabel();
+                    auto fill = a.createLabel();
+                    auto tail = a.createLabel();
+                    auto done = a.createLabel();
+                    auto fill_b = a.createLabel(), fill_w = a.createLabel(), fill_d = a.createLabel(), fill_q = a.createLabel();
+
+                    // one native path per (op, repne, size), ops which can't take repne trap
+                    //
+                    std::array<zasm::Label, 32> labels;
+                    for (size_t i = 0; i < labels.size(); i++)
+                        labels[i] = (i >> 2) == 4 || (i >> 2) == 5 ? trap : a.createLabel();
+
+                    a.bind(global_labels["vrep"]);
+
+                    create_jump_table_once(a, native_paths, labels);
+
+                    a.movzx(zasm::x86::r11d, zasm::x86::byte_ptr(vip));
+                    a.shr(zasm::x86::r11d, 6); // size bits
+                    a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip, 1)); // kind
+                    a.add(vip, 2);
+
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+
+                    // comparisons and a set direction flag run the real instruction
+                    //
+                    a.cmp(zasm::x86::edx, uint8_t(v0_rep_op::cmps));
+                    a.jae(native);
+                    a.bt(zasm::x86::qword_ptr(zasm::x86::r9, vflags_offset), 10);
+                    a.jc(native);
+
+                    // r10 = total bytes
+                    //
+                    a.mov(zasm::x86::ecx, zasm::x86::r11d);
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r9, 1 * 8));
+                    a.shl(zasm::x86::r10, zasm::x86::cl);
+
+                    a.lea(zasm::x86::rcx, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vrep_scratch"]));
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::rcx), zasm::x86::xmm0);
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::rcx, 16), zasm::x86::xmm1);
+
+                    a.cmp(zasm::x86::edx, uint8_t(v0_rep_op::stos));
+                    a.je(stos);
+
+                    // movs: a destination inside the source replicates data, leave that to the cpu
+                    //
+                    a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r9, 7 * 8));
+                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(zasm::x86::r9, 6 * 8));
+                    a.mov(zasm::x86::rcx, zasm::x86::rdx);
+                    a.sub(zasm::x86::rcx, zasm::x86::r11);
+                    a.cmp(zasm::x86::rcx, zasm::x86::r10);
+                    a.jb(native);
+
+                    // the final register state is known up front
+                    //
+                    a.add(zasm::x86::qword_ptr(zasm::x86::r9, 7 * 8), zasm::x86::r10);
+                    a.add(zasm::x86::qword_ptr(zasm::x86::r9, 6 * 8), zasm::x86::r10);
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 1 * 8), 0);
+                    a.mov(zasm::x86::r9, zasm::x86::r11);
+
+                    a.bind(copy);
+                    a.cmp(zasm::x86::r10, 32);
+                    a.jb(tail);
+                    a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r9));
+                    a.movdqu(zasm::x86::xmm1, zasm::x86::xmmword_ptr(zasm::x86::r9, 16));
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::rdx), zasm::x86::xmm0);
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::rdx, 16), zasm::x86::xmm1);
+                    a.add(zasm::x86::r9, 32);
+                    a.add(zasm::x86::rdx, 32);
+                    a.sub(zasm::x86::r10, 32);
+                    a.jmp(copy);
+
+                    // stos: broadcast the element in rax across xmm0
+                    //
+                    a.bind(stos);
+                    a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r9, 7 * 8));
+                    a.add(zasm::x86::qword_ptr(zasm::x86::r9, 7 * 8), zasm::x86::r10);
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 1 * 8), 0);
+                    a.mov(zasm::x86::rcx, zasm::x86::qword_ptr(zasm::x86::r9, 0 * 8));
+
+                    a.cmp(zasm::x86::r11d, 0b00);
+                    a.je(fill_b);
+                    a.cmp(zasm::x86::r11d, 0b01);
+                    a.je(fill_w);
+                    a.cmp(zasm::x86::r11d, 0b10);
+                    a.je(fill_d);
+                    a.jmp(fill_q);
+
+                    a.bind(fill_b);
+                    a.movd(zasm::x86::xmm0, zasm::x86::ecx);
+                    a.pxor(zasm::x86::xmm1, zasm::x86::xmm1);
+                    a.pshufb(zasm::x86::xmm0, zasm::x86::xmm1);
+                    a.jmp(fill);
+                    a.bind(fill_w);
+                    a.movd(zasm::x86::xmm0, zasm::x86::ecx);
+                    a.pshuflw(zasm::x86::xmm0, zasm::x86::xmm0, 0);
+                    a.pshufd(zasm::x86::xmm0, zasm::x86::xmm0, 0);
+                    a.jmp(fill);
+                    a.bind(fill_d);
+                    a.movd(zasm::x86::xmm0, zasm::x86::ecx);
+                    a.pshufd(zasm::x86::xmm0, zasm::x86::xmm0, 0);
+                    a.jmp(fill);
+                    a.bind(fill_q);
+                    a.movq(zasm::x86::xmm0, zasm::x86::rcx);
+                    a.punpcklqdq(zasm::x86::xmm0, zasm::x86::xmm0);
+
+                    // the tail copies from the pattern itself, 32 bytes is enough for any remainder
+                    //
+                    a.bind(fill);
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vrep_pattern"]));
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r9), zasm::x86::xmm0);
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r9, 16), zasm::x86::xmm0);
+                    auto fill_loop = a.createLabel();
+                    a.bind(fill_loop);
+                    a.cmp(zasm::x86::r10, 32);
+                    a.jb(tail);
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::rdx), zasm::x86::xmm0);
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::rdx, 16), zasm::x86::xmm0);
+                    a.add(zasm::x86::rdx, 32);
+                    a.sub(zasm::x86::r10, 32);
+                    a.jmp(fill_loop);
+
+                    a.bind(tail);
+                    a.cmp(zasm::x86::r10, 0);
+                    a.je(done);
+                    a.mov(zasm::x86::cl, zasm::x86::byte_ptr(zasm::x86::r9));
+                    a.mov(zasm::x86::byte_ptr(zasm::x86::rdx), zasm::x86::cl);
+                    a.add(zasm::x86::r9, 1);
+                    a.add(zasm::x86::rdx, 1);
+                    a.sub(zasm::x86::r10, 1);
+                    a.jmp(tail);
+
+                    a.bind(done);
+                    a.lea(zasm::x86::rcx, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vrep_scratch"]));
+                    a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::rcx));
+                    a.movdqu(zasm::x86::xmm1, zasm::x86::xmmword_ptr(zasm::x86::rcx, 16));
+                    vm_next_instruction(a);
+
+                    // native: load rsi, rdi, rcx, rax and rflags from the context, run the
+                    // instruction and write them back (rax is only ever read)
+                    //
+                    a.bind(native);
+                    a.mov(zasm::x86::ecx, zasm::x86::edx);
+                    a.and_(zasm::x86::ecx, 0b11);
+                    a.shr(zasm::x86::edx, 7);
+                    a.lea(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::rcx, zasm::x86::rdx, 4));
+                    a.lea(zasm::x86::ecx, zasm::x86::dword_ptr(zasm::x86::r11, zasm::x86::rcx, 4));
+                    a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::rip, native_paths));
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r10, zasm::x86::rcx, 8));
+
+                    a.push(vip);
+                    a.push(vsp);
+                    a.push(zasm::x86::qword_ptr(zasm::x86::r9, vflags_offset));
+                    a.popfq();
+                    a.mov(zasm::x86::rcx, zasm::x86::qword_ptr(zasm::x86::r9, 1 * 8));
+                    a.mov(zasm::x86::rsi, zasm::x86::qword_ptr(zasm::x86::r9, 6 * 8));
+                    a.mov(zasm::x86::rdi, zasm::x86::qword_ptr(zasm::x86::r9, 7 * 8));
+                    a.mov(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::r9, 0 * 8));
+                    a.jmp(zasm::x86::r10);
+
+                    for (int op = 0; op < 4; op++) {
+                        for (int ne = 0; ne < 2; ne++) {
+                            if (ne && op < int(v0_rep_op::cmps))
+                                continue;
+
+                            for (int size = 0; size < 4; size++) {
+                                a.bind(labels[(op | ne << 2) << 2 | size]);
+                                emit_string_instruction(a, v0_rep_op(op), ne, size);
+                                a.jmp(native_done);
+                            }
+                        }
+                    }
+
+                    a.bind(native_paths);
+                    a.dq(0, labels.size());
+
+                    a.bind(native_done);
+                    a.pushfq();
+                    a.pop(zasm::x86::r10);
+                    a.cld();
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 1 * 8), zasm::x86::rcx);
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 6 * 8), zasm::x86::rsi);
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 7 * 8), zasm::x86::rdi);
+                    a.pop(vsp);
+                    a.pop(vip);
+
+                    // movs/stos ran on the guest's own flags, so this only changes them for comparisons
+                    //
+                    store_vflags(a, zasm::x86::r10);
+                    vm_next_instruction(a);
+
+                    a.bind(trap);
+                    a.ud2();
+                }
+            },
+            {
+                uint8_t(v0_op::ea), [&](zasm::x86::Assembler& a) {
+                    auto no_base = a.createLabel();
+                    auto no_index = a.createLabel();
+                    auto no_fs = a.createLabel();
+                    auto no_gs = a.createLabel();
+
+                    // base, index, scale (as a shift) with the segment bits, disp32
+                    //
+                    a.bind(global_labels["vea"]);
+                    a.add(vip, 1);
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                    a.movsxd(zasm::x86::rdx, zasm::x86::dword_ptr(vip, 3));
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip));
+                    a.cmp(zasm::x86::ecx, ea_none);
+                    a.je(no_base);
+                    a.add(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rcx, 8));
+                    a.bind(no_base);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip, 1));
+                    a.cmp(zasm::x86::ecx, ea_none);
+                    a.je(no_index);
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rcx, 8));
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip, 2));
+                    a.and_(zasm::x86::ecx, 3);
+                    a.shl(zasm::x86::r10, zasm::x86::cl);
+                    a.add(zasm::x86::rdx, zasm::x86::r10);
+                    a.bind(no_index);
+
+                    // the segment base is read at each use rather than kept in the
+                    // context, the guest may change it between entries (needs fsgsbase,
+                    // which linux and windows enable for user mode)
+                    //
+                    a.test(zasm::x86::byte_ptr(vip, 2), ea_fs);
+                    a.jz(no_fs);
+                    a.rdfsbase(zasm::x86::r10);
+                    a.add(zasm::x86::rdx, zasm::x86::r10);
+                    a.bind(no_fs);
+                    a.test(zasm::x86::byte_ptr(vip, 2), ea_gs);
+                    a.jz(no_gs);
+                    a.rdgsbase(zasm::x86::r10);
+                    a.add(zasm::x86::rdx, zasm::x86::r10);
+                    a.bind(no_gs);
+
+                    a.add(vip, 7);
+                    a.sub(vsp, 8);
+                    a.mov(zasm::x86::qword_ptr(vsp), zasm::x86::rdx);
+                    vm_next_instruction(a);
+                }
+            },
+            {
+                uint8_t(v0_op::shift), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
+
+                    // count byte on top of the value, kind follows the opcode
+                    //
+                    auto vshiftz = [&]<typename T>(int size, zasm::x86::Gp v, T ptr) {
+                        auto paths = [&]{ std::array<zasm::Label, 5> res; for (auto&x:res) x = a.createLabel(); return res; }();
+                        auto shifted = a.createLabel();
+                        auto rotated = a.createLabel();
+
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::shift, size)) return;
+                        a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vsp));
+                        a.add(vsp, 1);
+                        a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip));
+                        a.add(vip, 1);
+                        a.mov(v, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+
+                        for (int kind = 0; kind < 5; kind++) {
+                            a.cmp(zasm::x86::edx, kind);
+                            a.je(paths[kind]);
+                        }
+                        a.ud2();
+
+                        a.bind(paths[int(v0_shift_op::shl)]); a.shl(v, zasm::x86::cl); a.jmp(shifted);
+                        a.bind(paths[int(v0_shift_op::shr)]); a.shr(v, zasm::x86::cl); a.jmp(shifted);
+                        a.bind(paths[int(v0_shift_op::sar)]); a.sar(v, zasm::x86::cl); a.jmp(shifted);
+                        a.bind(paths[int(v0_shift_op::rol)]); a.rol(v, zasm::x86::cl); a.jmp(rotated);
+                        a.bind(paths[int(v0_shift_op::ror)]); a.ror(v, zasm::x86::cl); a.jmp(rotated);
+
+                        // a masked count of zero leaves the flags alone, rotates only touch CF and OF
+                        //
+                        a.bind(shifted);
+                        a.pushfq();
+                        a.pop(zasm::x86::r11);
+                        a.mov(ptr(std::forward<zasm::x86::Gp64>(vsp)), v);
+                        a.test(zasm::x86::cl, size == 0b11 ? 0x3f : 0x1f);
+                        a.jz(labels[5]);
+                        store_vflags(a, zasm::x86::r11);
+                        a.jmp(labels[5]);
+
+                        a.bind(rotated);
+                        a.pushfq();
+                        a.pop(zasm::x86::r11);
+                        a.mov(ptr(std::forward<zasm::x86::Gp64>(vsp)), v);
+                        a.test(zasm::x86::cl, size == 0b11 ? 0x3f : 0x1f);
+                        a.jz(labels[5]);
+                        store_vflags(a, zasm::x86::r11, 0x801);
+                        a.jmp(labels[5]);
+                    };
+
+                    get_size_from_opcode(a, global_labels["vshift"]);
+
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
+
+                    vshiftz(0b00, zasm::x86::r10b, zasm::x86::byte_ptr<zasm::x86::Gp64>);
+                    vshiftz(0b01, zasm::x86::r10w, zasm::x86::word_ptr<zasm::x86::Gp64>);
+                    vshiftz(0b10, zasm::x86::r10d, zasm::x86::dword_ptr<zasm::x86::Gp64>);
+                    vshiftz(0b11, zasm::x86::r10, zasm::x86::qword_ptr<zasm::x86::Gp64>);
+
+                    vm_next_instruction(a, labels[5]);
+                }
+            },
+            {
+                uint8_t(v0_op::mul), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
+
+                    auto vmulz = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
+                        auto wide = a.createLabel();
+                        auto paths = [&]{ std::array<zasm::Label, 5> res; for (auto&x:res) x = a.createLabel(); return res; }();
+                        auto store = a.createLabel();
+
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::mul, size)) return;
+                        a.movzx(zasm::x86::r11d, zasm::x86::byte_ptr(vip));
+                        a.add(vip, 1);
+                        a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        a.add(vsp, 1 << size);
+                        a.cmp(zasm::x86::r11d, uint8_t(v0_mul_op::imul2));
+                        a.jne(wide);
+
+                        // there is no two operand imul for bytes, nor does the lifter emit one
+                        //
+                        if (size == 0b00)
+                            a.ud2();
+                        else {
+                            a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                            a.imul(v1, v0);
+                            a.pushfq();
+                            a.pop(zasm::x86::r11);
+                            a.mov(ptr(std::forward<zasm::x86::Gp64>(vsp)), v1);
+                            store_vflags(a, zasm::x86::r11);
+                            a.jmp(labels[5]);
+                        }
+
+                        // the one operand forms run on the guest's rax/rdx, which means borrowing vip
+                        //
+                        a.bind(wide);
+                        a.push(vip);
+                        a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                        a.mov(zasm::x86::rax, zasm::x86::qword_ptr(zasm::x86::r9, 0 * 8));
+                        a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r9, 2 * 8));
+
+                        for (auto kind : { v0_mul_op::mul, v0_mul_op::imul, v0_mul_op::div }) {
+                            a.cmp(zasm::x86::r11d, uint8_t(kind));
+                            a.je(paths[int(kind)]);
+                        }
+
+                        a.bind(paths[int(v0_mul_op::idiv)]); a.idiv(v0); a.jmp(store);
+                        a.bind(paths[int(v0_mul_op::mul)]); a.mul(v0); a.jmp(store);
+                        a.bind(paths[int(v0_mul_op::imul)]); a.imul(v0); a.jmp(store);
+                        a.bind(paths[int(v0_mul_op::div)]); a.div(v0);
+
+                        a.bind(store);
+                        a.pushfq();
+                        a.pop(zasm::x86::r11);
+                        a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 0 * 8), zasm::x86::rax);
+                        a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 2 * 8), zasm::x86::rdx);
+                        a.pop(vip);
+                        store_vflags(a, zasm::x86::r11);
+                        a.jmp(labels[5]);
+                    };
+
+                    get_size_from_opcode(a, global_labels["vmul"]);
+
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
+
+                    vmulz(0b00, zasm::x86::r10b, zasm::x86::cl, zasm::x86::byte_ptr<zasm::x86::Gp64>);
+                    vmulz(0b01, zasm::x86::r10w, zasm::x86::cx, zasm::x86::word_ptr<zasm::x86::Gp64>);
+                    vmulz(0b10, zasm::x86::r10d, zasm::x86::ecx, zasm::x86::dword_ptr<zasm::x86::Gp64>);
+                    vmulz(0b11, zasm::x86::r10, zasm::x86::rcx, zasm::x86::qword_ptr<zasm::x86::Gp64>);
+
+                    vm_next_instruction(a, labels[5]);
+                }
+            },
+            {
+                uint8_t(v0_op::setcc), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["vsetcc"]);
+                    a.add(vip, 1);
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip)); // condition
+                    a.add(vip, 1);
+                    load_vflags(a);
+
+                    test_condition(a);
+
+                    a.setb(zasm::x86::cl);
+                    a.sub(vsp, 1);
+                    a.mov(zasm::x86::byte_ptr(vsp), zasm::x86::cl);
+                    vm_next_instruction(a);
+                }
+            },
+            {
+                uint8_t(v0_op::cmov), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
+
+                    // source on top of the destination, leaves the selected value
+                    //
+                    auto vcmovz = [&]<typename T>(int size, zasm::x86::Gp v0, zasm::x86::Gp v1, T ptr) {
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::cmov, size)) return;
+
+                        // there is no byte cmov, nor does the lifter emit one
+                        //
+                        if (size == 0b00) {
+                            a.ud2();
+                            return;
+                        }
+
+                        a.mov(v0, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        a.add(vsp, 1 << size);
+                        a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip)); // condition
+                        a.add(vip, 1);
+                        load_vflags(a);
+
+                        test_condition(a);
+
+                        a.mov(v1, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        a.cmovb(v1, v0);
+                        a.mov(ptr(std::forward<zasm::x86::Gp64>(vsp)), v1);
+                        a.jmp(labels[5]);
+                    };
+
+                    get_size_from_opcode(a, global_labels["vcmov"]);
+
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
+
+                    vcmovz(0b00, zasm::x86::r11b, zasm::x86::cl, zasm::x86::byte_ptr<zasm::x86::Gp64>);
+                    vcmovz(0b01, zasm::x86::r11w, zasm::x86::cx, zasm::x86::word_ptr<zasm::x86::Gp64>);
+                    vcmovz(0b10, zasm::x86::r11d, zasm::x86::ecx, zasm::x86::dword_ptr<zasm::x86::Gp64>);
+                    vcmovz(0b11, zasm::x86::r11, zasm::x86::rcx, zasm::x86::qword_ptr<zasm::x86::Gp64>);
+
+                    vm_next_instruction(a, labels[5]);
+                }
+            },
+            {
+                uint8_t(v0_op::ext), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
+                    auto push = [&]{ std::array<zasm::Label, 4> res; for (auto&x:res) x = a.createLabel(); return res; }();
+                    auto extended = a.createLabel();
+
+                    // r10 = source extended to 64 bits
+                    //
+                    auto vextz = [&]<typename T>(int size, T ptr) {
+                        auto zext = a.createLabel();
+
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::ext, size)) return;
+                        a.cmp(zasm::x86::edx, uint8_t(v0_ext_op::zext));
+                        a.je(zext);
+
+                        if (size == 0b11)
+                            a.mov(zasm::x86::r10, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        else if (size == 0b10)
+                            a.movsxd(zasm::x86::r10, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        else
+                            a.movsx(zasm::x86::r10, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        a.cmp(zasm::x86::edx, uint8_t(v0_ext_op::sign));
+                        a.jne(extended);
+                        a.sar(zasm::x86::r10, 63);
+                        a.jmp(extended);
+
+                        a.bind(zext);
+                        if (size == 0b11)
+                            a.mov(zasm::x86::r10, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        else if (size == 0b10)
+                            a.mov(zasm::x86::r10d, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        else
+                            a.movzx(zasm::x86::r10, ptr(std::forward<zasm::x86::Gp64>(vsp)));
+                        a.jmp(extended);
+                    };
+
+                    get_size_from_opcode(a, global_labels["vext"]);
+                    a.mov(zasm::x86::r11, zasm::x86::rcx);
+
+                    // edx = kind, the destination size is read back once the source is popped
+                    //
+                    a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip));
+                    a.shr(zasm::x86::edx, 2);
+                    a.add(vip, 1);
+
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
+
+                    vextz(0b00, zasm::x86::byte_ptr<zasm::x86::Gp64>);
+                    vextz(0b01, zasm::x86::word_ptr<zasm::x86::Gp64>);
+                    vextz(0b10, zasm::x86::dword_ptr<zasm::x86::Gp64>);
+                    vextz(0b11, zasm::x86::qword_ptr<zasm::x86::Gp64>);
+
+                    a.bind(extended);
+                    a.mov(zasm::x86::ecx, zasm::x86::r11d);
+                    a.mov(zasm::x86::r11d, 1);
+                    a.shl(zasm::x86::r11d, zasm::x86::cl);
+                    a.add(vsp, zasm::x86::r11);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip, -1));
+                    a.and_(zasm::x86::ecx, 0b11);
+                    for (int size = 0; size < 3; size++) {
+                        a.cmp(zasm::x86::ecx, size);
+                        a.je(push[size]);
+                    }
+
+                    a.bind(push[3]); a.sub(vsp, 8); a.mov(zasm::x86::qword_ptr(vsp), zasm::x86::r10); a.jmp(labels[5]);
+                    a.bind(push[2]); a.sub(vsp, 4); a.mov(zasm::x86::dword_ptr(vsp), zasm::x86::r10d); a.jmp(labels[5]);
+                    a.bind(push[1]); a.sub(vsp, 2); a.mov(zasm::x86::word_ptr(vsp), zasm::x86::r10w); a.jmp(labels[5]);
+                    a.bind(push[0]); a.sub(vsp, 1); a.mov(zasm::x86::byte_ptr(vsp), zasm::x86::r10b);
+
+                    vm_next_instruction(a, labels[5]);
+                }
+            },
+            {
+                uint8_t(v0_op::spush), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["vspush"]);
+                    a.add(vip, 1);
+                    a.mov(zasm::x86::rcx, zasm::x86::qword_ptr(vsp));
+                    a.add(vsp, 8);
+
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r9, 4 * 8));
+                    a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r10, -8));
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r10), zasm::x86::rcx);
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 4 * 8), zasm::x86::r10);
+                    vm_next_instruction(a);
+                }
+            },
+            {
+                uint8_t(v0_op::spop), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["vspop"]);
+                    a.add(vip, 1);
+
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r9, 4 * 8));
+                    a.mov(zasm::x86::rcx, zasm::x86::qword_ptr(zasm::x86::r10));
+                    a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r10, 8));
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 4 * 8), zasm::x86::r10);
+
+                    a.sub(vsp, 8);
+                    a.mov(zasm::x86::qword_ptr(vsp), zasm::x86::rcx);
+                    vm_next_instruction(a);
+                }
+            },
+            {
+                uint8_t(v0_op::ret), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["vret"]);
+                    a.add(vip, 1);
+                    a.movzx(zasm::x86::ecx, zasm::x86::word_ptr(vip));
+
+                    // leave the vm straight to the guest's return address
+                    //
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r9, 4 * 8));
+                    a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r10));
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::rip, global_labels["retaddr"]), zasm::x86::rdx);
+                    a.lea(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r10, zasm::x86::rcx, 1, 8));
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9, 4 * 8), zasm::x86::r10);
+
+                    exit_vm(a);
+                }
+            },
+            {
+                uint8_t(v0_op::jmp_table), [&](zasm::x86::Assembler& a) {
+                    auto out_of_range = a.createLabel();
+
+                    // count, then one bytecode offset per case; the case number is on the stack
+                    //
+                    a.bind(global_labels["vjmp_table"]);
+                    a.movzx(zasm::x86::ecx, zasm::x86::word_ptr(vip, 1));
+                    a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(vsp));
+                    a.add(vsp, 8);
+                    a.cmp(zasm::x86::rdx, zasm::x86::rcx);
+                    a.jae(out_of_range);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::word_ptr(vip, zasm::x86::rdx, 2, 3));
+                    a.lea(vip, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcode"]));
+                    a.add(vip, zasm::x86::rcx);
+                    vm_next_instruction(a);
+
+                    a.bind(out_of_range);
+                    a.ud2();
+                }
+            },
+            {
+                uint8_t(v0_op::atomic), [&](zasm::x86::Assembler& a) {
+                    static constexpr int kinds = int(v0_atomic_op::dec) + 1;
+
+                    auto paths = a.createLabel();
+                    auto trap = a.createLabel();
+                    auto done = a.createLabel();
+
+                    // one path per (size, kind)
+                    //
+                    std::array<zasm::Label, 64> labels;
+                    for (size_t i = 0; i < labels.size(); i++)
+                        labels[i] = (i & 0xf) < kinds ? a.createLabel() : trap;
+
+                    a.bind(global_labels["vatomic"]);
+
+                    create_jump_table_once(a, paths, labels);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip));
+                    a.shr(zasm::x86::ecx, 6);
+                    a.shl(zasm::x86::ecx, 4);
+                    a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip, 1));
+                    a.or_(zasm::x86::ecx, zasm::x86::edx);
+                    a.add(vip, 2);
+
+                    // the address is on top, the operands (if any) below it
+                    //
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(vsp));
+                    jump_using_table(a, paths, labels.size());
+
+                    static const std::array<zasm::x86::Gp, 4> values = { zasm::x86::r11b, zasm::x86::r11w, zasm::x86::r11d, zasm::x86::r11 };
+                    static const std::array<zasm::x86::Gp, 4> accumulators = { zasm::x86::al, zasm::x86::ax, zasm::x86::eax, zasm::x86::rax };
+
+                    for (int size = 0; size < 4; size++) {
+                        int bytes = 1 << size;
+
+                        for (int kind = 0; kind < kinds; kind++) {
+                            auto op = v0_atomic_op(kind);
+
+                            a.bind(labels[size << 4 | kind]);
+                            if (skip_variant(a, v0_op::atomic, size)) continue;
+
+                            switch (op) {
+                            case v0_atomic_op::xchg:
+                            case v0_atomic_op::xadd:
+                                a.mov(values[size], stack_slot(size, 8));
+                                emit_locked_instruction(a, op, size);
+                                a.pushfq();
+                                a.pop(zasm::x86::rdx);
+                                a.add(vsp, 8);
+                                a.mov(stack_slot(size, 0), values[size]);
+                                if (op == v0_atomic_op::xadd)
+                                    store_vflags(a, zasm::x86::rdx);
+                                break;
+
+                            // the accumulator is vip, so it's parked on the handler stack
+                            //
+                            case v0_atomic_op::cmpxchg:
+                                a.push(vip);
+                                a.mov(accumulators[size], stack_slot(size, 8));
+                                a.mov(values[size], stack_slot(size, 8 + bytes));
+                                emit_locked_instruction(a, op, size);
+                                a.pushfq();
+                                a.pop(zasm::x86::rdx);
+                                a.mov(stack_slot(size, 8 + bytes), accumulators[size]);
+                                a.pop(vip);
+                                a.add(vsp, 8 + bytes);
+                                store_vflags(a, zasm::x86::rdx);
+                                break;
+
+                            case v0_atomic_op::inc:
+                            case v0_atomic_op::dec:
+                                emit_locked_instruction(a, op, size);
+                                a.pushfq();
+                                a.pop(zasm::x86::rdx);
+                                a.add(vsp, 8);
+                                store_vflags(a, zasm::x86::rdx, arith_flags & ~1u);
+                                break;
+
+                            default:
+                                a.mov(values[size], stack_slot(size, 8));
+                                emit_locked_instruction(a, op, size);
+                                a.pushfq();
+                                a.pop(zasm::x86::rdx);
+                                a.add(vsp, 8 + bytes);
+                                store_vflags(a, zasm::x86::rdx);
+                                break;
+                            }
+
+                            a.jmp(done);
+                        }
+                    }
+
+                    a.bind(trap);
+                    a.ud2();
+
+                    vm_next_instruction(a, done);
+                }
+            },
+            {
+                uint8_t(v0_op::bitop), [&](zasm::x86::Assembler& a) {
+                    static constexpr int kinds = int(v0_bit_op::pdep) + 1;
+
+                    auto paths = a.createLabel();
+                    auto trap = a.createLabel();
+                    auto done = a.createLabel();
+
+                    // one path per (size, kind), there are no byte forms and the
+                    // bmi ones have no word forms either
+                    //
+                    auto exists = [](size_t size, size_t kind) {
+                        return size != 0b00 && kind < kinds && (size != 0b01 || kind < int(v0_bit_op::andn));
+                    };
+
+                    std::array<zasm::Label, 64> labels;
+                    for (size_t i = 0; i < labels.size(); i++)
+                        labels[i] = exists(i >> 4, i & 0xf) ? a.createLabel() : trap;
+
+                    a.bind(global_labels["vbitop"]);
+
+                    create_jump_table_once(a, paths, labels);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip));
+                    a.shr(zasm::x86::ecx, 6);
+                    a.shl(zasm::x86::ecx, 4);
+                    a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip, 1));
+                    a.or_(zasm::x86::ecx, zasm::x86::edx);
+                    a.add(vip, 2);
+                    jump_using_table(a, paths, labels.size());
+
+                    static const std::array<zasm::x86::Gp, 4> r10 = { zasm::x86::r10b, zasm::x86::r10w, zasm::x86::r10d, zasm::x86::r10 };
+                    static const std::array<zasm::x86::Gp, 4> r11 = { zasm::x86::r11b, zasm::x86::r11w, zasm::x86::r11d, zasm::x86::r11 };
+
+                    for (int size = 0b01; size < 4; size++) {
+                        int bytes = 1 << size;
+                        auto x = r10[size], y = r11[size];
+
+                        for (int kind = 0; kind < kinds; kind++) {
+                            auto op = v0_bit_op(kind);
+                            if (!exists(size, kind))
+                                continue;
+
+                            bool unary = (op >= v0_bit_op::popcnt && op <= v0_bit_op::tzcnt) || (op >= v0_bit_op::blsr && op <= v0_bit_op::blsmsk);
+
+                            a.bind(labels[size << 4 | kind]);
+                            if (skip_variant(a, v0_op::bitop, size)) continue;
+
+                            // x = first operand (or the result), y = second
+                            //
+                            a.mov(y, stack_slot(size, 0));
+                            if (!unary)
+                                a.mov(x, stack_slot(size, bytes));
+
+                            switch (op) {
+                            case v0_bit_op::bt: a.bt(x, y); break;
+                            case v0_bit_op::bts: a.bts(x, y); break;
+                            case v0_bit_op::btr: a.btr(x, y); break;
+                            case v0_bit_op::btc: a.btc(x, y); break;
+                            case v0_bit_op::bsf: a.bsf(x, y); break;
+                            case v0_bit_op::bsr: a.bsr(x, y); break;
+                            case v0_bit_op::popcnt: a.popcnt(x, y); break;
+                            case v0_bit_op::lzcnt: a.lzcnt(x, y); break;
+                            case v0_bit_op::tzcnt: a.tzcnt(x, y); break;
+                            case v0_bit_op::andn: a.andn(x, x, y); break;
+                            case v0_bit_op::blsr: a.blsr(x, y); break;
+                            case v0_bit_op::blsi: a.blsi(x, y); break;
+                            case v0_bit_op::blsmsk: a.blsmsk(x, y); break;
+                            case v0_bit_op::pext: a.pext(x, x, y); break;
+                            case v0_bit_op::pdep: a.pdep(x, x, y); break;
+                            }
+
+                            // pext/pdep leave the flags alone and the bt family only
+                            // defines CF, the guest's other flags have to survive them
+                            //
+                            bool bmi2 = op == v0_bit_op::pext || op == v0_bit_op::pdep;
+                            bool bit_test = op >= v0_bit_op::bt && op <= v0_bit_op::btc;
+
+                            if (!bmi2) {
+                                a.pushfq();
+                                a.pop(zasm::x86::rdx);
+                            }
+                            if (op == v0_bit_op::bt)
+                                a.add(vsp, 2 * bytes);
+                            else {
+                                if (!unary)
+                                    a.add(vsp, bytes);
+                                a.mov(stack_slot(size, 0), x);
+                            }
+                            if (!bmi2)
+                                store_vflags(a, zasm::x86::rdx, bit_test ? 1u : arith_flags);
+                            a.jmp(done);
+                        }
+                    }
+
+                    a.bind(trap);
+                    a.ud2();
+
+                    vm_next_instruction(a, done);
+                }
+            },
+            {
+                uint8_t(v0_op::arith), [&](zasm::x86::Assembler& a) {
+                    static constexpr int kinds = int(v0_arith_op::sbb) + 1;
+
+                    auto paths = a.createLabel();
+                    auto trap = a.createLabel();
+                    auto done = a.createLabel();
+
+                    // one path per (size, kind)
+                    //
+                    std::array<zasm::Label, 32> labels;
+                    for (size_t i = 0; i < labels.size(); i++)
+                        labels[i] = (i & 0b111) < kinds ? a.createLabel() : trap;
+
+                    a.bind(global_labels["varith"]);
+
+                    create_jump_table_once(a, paths, labels);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip));
+                    a.shr(zasm::x86::ecx, 6);
+                    a.shl(zasm::x86::ecx, 3);
+                    a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip, 1));
+                    a.or_(zasm::x86::ecx, zasm::x86::edx);
+                    a.add(vip, 2);
+                    jump_using_table(a, paths, labels.size());
+
+                    static const std::array<zasm::x86::Gp, 4> r10 = { zasm::x86::r10b, zasm::x86::r10w, zasm::x86::r10d, zasm::x86::r10 };
+                    static const std::array<zasm::x86::Gp, 4> r11 = { zasm::x86::r11b, zasm::x86::r11w, zasm::x86::r11d, zasm::x86::r11 };
+
+                    // the mba pass rewrites add/sub/and/or/xor into sequences which
+                    // trash the flags, adc/sbb/test are left alone so the flags come
+                    // from those; rdx holds them until the stack is updated
+                    //
+                    for (int size = 0; size < 4; size++) {
+                        int bytes = 1 << size;
+                        auto x = r10[size], y = r11[size];
+
+                        for (int kind = 0; kind < kinds; kind++) {
+                            auto op = v0_arith_op(kind);
+
+                            a.bind(labels[size << 3 | kind]);
+                            if (skip_variant(a, v0_op::arith, size)) continue;
+
+                            a.mov(y, stack_slot(size, 0));
+                            a.mov(x, stack_slot(size, bytes));
+
+                            switch (op) {
+                            case v0_arith_op::add: a.clc(); a.adc(x, y); break;
+                            case v0_arith_op::sub: a.clc(); a.sbb(x, y); break;
+                            case v0_arith_op::adc:
+                            case v0_arith_op::sbb:
+                                a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                                a.bt(zasm::x86::qword_ptr(zasm::x86::r9, vflags_offset), 0);
+                                if (op == v0_arith_op::adc) a.adc(x, y);
+                                else a.sbb(x, y);
+                                break;
+                            case v0_arith_op::band:
+                                a.test(x, y);
+                                a.pushfq();
+                                a.and_(x, y);
+                                break;
+                            case v0_arith_op::bor: a.or_(x, y); a.test(x, x); break;
+                            case v0_arith_op::bxor: a.xor_(x, y); a.test(x, x); break;
+                            }
+
+                            if (op != v0_arith_op::band)
+                                a.pushfq();
+                            a.pop(zasm::x86::rdx);
+                            a.add(vsp, bytes);
+                            a.mov(stack_slot(size, 0), x);
+                            store_vflags(a, zasm::x86::rdx);
+                            a.jmp(done);
+                        }
+                    }
+
+                    a.bind(trap);
+                    a.ud2();
+
+                    vm_next_instruction(a, done);
+                }
+            },
+            {
+                uint8_t(v0_op::fp), [&](zasm::x86::Assembler& a) {
+                    static constexpr int kinds = int(v0_fp_op::cvts2s) + 1;
+
+                    auto paths = a.createLabel();
+                    auto trap = a.createLabel();
+                    auto done = a.createLabel();
+                    auto src_from_stack = a.createLabel();
+                    auto src_ready = a.createLabel();
+
+                    // one path per kind and width, sd at 0x20
+                    //
+                    std::array<zasm::Label, 64> labels;
+                    for (size_t i = 0; i < labels.size(); i++)
+                        labels[i] = (i & 0x1f) < kinds ? a.createLabel() : trap;
+
+                    a.bind(global_labels["vfp"]);
+
+                    create_jump_table_once(a, paths, labels);
+
+                    a.mov(zasm::x86::ecx, 1);
+                    spill_vector_state(a);
+
+                    // r10 = dst, r11 = src (a `vxmm` row or an address from the vstack)
+                    //
+                    a.movzx(zasm::x86::r10d, zasm::x86::byte_ptr(vip, 2));
+                    a.shl(zasm::x86::r10d, 5);
+                    a.add(zasm::x86::r10, zasm::x86::r9);
+                    a.movzx(zasm::x86::r11d, zasm::x86::byte_ptr(vip, 3));
+                    a.cmp(zasm::x86::r11d, vec_memory);
+                    a.je(src_from_stack);
+                    a.shl(zasm::x86::r11d, 5);
+                    a.add(zasm::x86::r11, zasm::x86::r9);
+                    a.jmp(src_ready);
+                    a.bind(src_from_stack);
+                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(vsp));
+                    a.add(vsp, 8);
+                    a.bind(src_ready);
+
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip));
+                    a.shr(zasm::x86::ecx, 6);
+                    a.and_(zasm::x86::ecx, 1);
+                    a.shl(zasm::x86::ecx, 5);
+                    a.movzx(zasm::x86::edx, zasm::x86::byte_ptr(vip, 1));
+                    a.or_(zasm::x86::ecx, zasm::x86::edx);
+                    a.add(vip, 4);
+                    jump_using_table(a, paths, labels.size());
+
+                    using zasm::x86::Mnemonic;
+
+                    // only the low element is loaded from src, a memory operand can
+                    // sit at the end of a page
+                    //
+                    for (int size = 2; size < 4; size++) {
+                        bool sd = size == 3;
+                        auto scalar = [&](zasm::x86::Gp64 base) { return sd ? zasm::x86::qword_ptr(base) : zasm::x86::dword_ptr(base); };
+                        auto movs = sd ? Mnemonic::Movsd : Mnemonic::Movss;
+
+                        for (int kind = 0; kind < kinds; kind++) {
+                            auto op = v0_fp_op(kind);
+
+                            a.bind(labels[(sd ? 0x20 : 0) | kind]);
+                            if (skip_variant(a, v0_op::fp, size)) continue;
+
+                            auto binary = [&](Mnemonic ss, Mnemonic sd_form) {
+                                a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r10));
+                                a.emit(movs, zasm::x86::xmm1, scalar(zasm::x86::r11));
+                                a.emit(sd ? sd_form : ss, zasm::x86::xmm0, zasm::x86::xmm1);
+                                a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                            };
+
+                            switch (op) {
+                            case v0_fp_op::mov: binary(Mnemonic::Movss, Mnemonic::Movsd); break;
+                            case v0_fp_op::load:
+                                a.emit(movs, zasm::x86::xmm0, scalar(zasm::x86::r11));
+                                a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                                break;
+                            case v0_fp_op::store:
+                                a.emit(movs, zasm::x86::xmm0, scalar(zasm::x86::r10));
+                                a.emit(movs, scalar(zasm::x86::r11), zasm::x86::xmm0);
+                                break;
+                            case v0_fp_op::add: binary(Mnemonic::Addss, Mnemonic::Addsd); break;
+                            case v0_fp_op::sub: binary(Mnemonic::Subss, Mnemonic::Subsd); break;
+                            case v0_fp_op::mul: binary(Mnemonic::Mulss, Mnemonic::Mulsd); break;
+                            case v0_fp_op::div: binary(Mnemonic::Divss, Mnemonic::Divsd); break;
+                            case v0_fp_op::min: binary(Mnemonic::Minss, Mnemonic::Minsd); break;
+                            case v0_fp_op::max: binary(Mnemonic::Maxss, Mnemonic::Maxsd); break;
+                            case v0_fp_op::sqrt: binary(Mnemonic::Sqrtss, Mnemonic::Sqrtsd); break;
+                            case v0_fp_op::cvts2s: binary(Mnemonic::Cvtss2sd, Mnemonic::Cvtsd2ss); break;
+
+                            // the compare result goes to the vm flags, where `jcc`,
+                            // `setcc` and `cmov` pick it up
+                            //
+                            case v0_fp_op::ucomi:
+                            case v0_fp_op::comi:
+                                a.emit(movs, zasm::x86::xmm0, scalar(zasm::x86::r10));
+                                if (op == v0_fp_op::ucomi)
+                                    a.emit(sd ? Mnemonic::Ucomisd : Mnemonic::Ucomiss, zasm::x86::xmm0, scalar(zasm::x86::r11));
+                                else
+                                    a.emit(sd ? Mnemonic::Comisd : Mnemonic::Comiss, zasm::x86::xmm0, scalar(zasm::x86::r11));
+                                a.pushfq();
+                                a.pop(zasm::x86::rdx);
+                                store_vflags(a, zasm::x86::rdx);
+                                break;
+
+                            case v0_fp_op::cvtsi2_32:
+                            case v0_fp_op::cvtsi2_64: {
+                                bool wide = op == v0_fp_op::cvtsi2_64;
+                                a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r10));
+                                if (wide)
+                                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(vsp));
+                                else
+                                    a.mov(zasm::x86::r11d, zasm::x86::dword_ptr(vsp));
+                                a.add(vsp, wide ? 8 : 4);
+                                a.emit(sd ? Mnemonic::Cvtsi2sd : Mnemonic::Cvtsi2ss, zasm::x86::xmm0, wide ? zasm::x86::Gp(zasm::x86::r11) : zasm::x86::Gp(zasm::x86::r11d));
+                                a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                                break;
+                            }
+                            case v0_fp_op::cvtt2si_32:
+                            case v0_fp_op::cvtt2si_64: {
+                                bool wide = op == v0_fp_op::cvtt2si_64;
+                                a.emit(sd ? Mnemonic::Cvttsd2si : Mnemonic::Cvttss2si, wide ? zasm::x86::Gp(zasm::x86::rdx) : zasm::x86::Gp(zasm::x86::edx), scalar(zasm::x86::r11));
+                                a.sub(vsp, wide ? 8 : 4);
+                                if (wide)
+                                    a.mov(zasm::x86::qword_ptr(vsp), zasm::x86::rdx);
+                                else
+                                    a.mov(zasm::x86::dword_ptr(vsp), zasm::x86::edx);
+                                break;
+                            }
+                            }
+                            a.jmp(done);
+                        }
+                    }
+
+                    a.bind(trap);
+                    a.ud2();
+
+                    vm_next_instruction(a, done);
+                }
+            },
+            {
+                uint8_t(v0_op::dup), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
+
+                    auto vdup = [&](int size, zasm::x86::Gp v0) {
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::dup, size)) return;
+                        a.mov(v0, stack_slot(size, 0));
+                        a.sub(vsp, 1 << size);
+                        a.mov(stack_slot(size, 0), v0);
+                        a.jmp(labels[5]);
+                    };
+
+                    get_size_from_opcode(a, global_labels["vdup"]);
+
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
+
+                    vdup(0b00, zasm::x86::cl);
+                    vdup(0b01, zasm::x86::cx);
+                    vdup(0b10, zasm::x86::ecx);
+                    vdup(0b11, zasm::x86::rcx);
+
+                    vm_next_instruction(a, labels[5]);
+                }
+            },
+            {
+                uint8_t(v0_op::swap), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
+
+                    auto vswap = [&](int size, zasm::x86::Gp v0, zasm::x86::Gp v1) {
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::swap, size)) return;
+                        a.mov(v0, stack_slot(size, 0));
+                        a.mov(v1, stack_slot(size, 1 << size));
+                        a.mov(stack_slot(size, 0), v1);
+                        a.mov(stack_slot(size, 1 << size), v0);
+                        a.jmp(labels[5]);
+                    };
+
+                    get_size_from_opcode(a, global_labels["vswap"]);
+
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
+
+                    vswap(0b00, zasm::x86::cl, zasm::x86::dl);
+                    vswap(0b01, zasm::x86::cx, zasm::x86::dx);
+                    vswap(0b10, zasm::x86::ecx, zasm::x86::edx);
+                    vswap(0b11, zasm::x86::rcx, zasm::x86::rdx);
+
+                    vm_next_instruction(a, labels[5]);
+                }
+            },
+            {
+                uint8_t(v0_op::over), [&](zasm::x86::Assembler& a) {
+                    auto labels = [&]{ std::array<zasm::Label, 6> res; for (auto&x:res) x = a.createLabel(); return res; }();
+
+                    auto vover = [&](int size, zasm::x86::Gp v0) {
+                        a.bind(labels[1 + size]);
+                        if (skip_variant(a, v0_op::over, size)) return;
+                        a.mov(v0, stack_slot(size, 1 << size));
+                        a.sub(vsp, 1 << size);
+                        a.mov(stack_slot(size, 0), v0);
+                        a.jmp(labels[5]);
+                    };
+
+                    get_size_from_opcode(a, global_labels["vover"]);
+
+                    create_jump_table_once(a, labels[0], labels[1], labels[2], labels[3], labels[4]);
+                    jump_using_table(a, labels[0]);
+
+                    vover(0b00, zasm::x86::cl);
+                    vover(0b01, zasm::x86::cx);
+                    vover(0b10, zasm::x86::ecx);
+                    vover(0b11, zasm::x86::rcx);
+
+                    vm_next_instruction(a, labels[5]);
+                }
+            },
+            {
+                uint8_t(v0_op::intrinsic), [&](zasm::x86::Assembler& a) {
+                    static constexpr int kinds = int(v0_intrinsic::strlen) + 1;
+
+                    auto paths = a.createLabel();
+                    auto trap = a.createLabel();
+                    auto done = a.createLabel();
+
+                    std::array<zasm::Label, 8> labels;
+                    for (size_t i = 0; i < labels.size(); i++)
+                        labels[i] = i < kinds ? a.createLabel() : trap;
+
+                    auto at = [&](v0_intrinsic kind) { return labels[size_t(kind)]; };
+
+                    a.bind(global_labels["vintrinsic"]);
+
+                    create_jump_table_once(a, paths, labels);
+
+                    // the guest's xmm0/xmm1 go where `rep` keeps them
+                    //
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vrep_scratch"]));
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r9), zasm::x86::xmm0);
+                    a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r9, 16), zasm::x86::xmm1);
+
+                    // r10, r11, rdx = the first three arguments, the result is left in rcx
+                    //
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip, 2));
+                    a.mov(zasm::x86::r10, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rcx, 8));
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip, 3));
+                    a.mov(zasm::x86::r11, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rcx, 8));
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip, 4));
+                    a.mov(zasm::x86::rdx, zasm::x86::qword_ptr(zasm::x86::r9, zasm::x86::rcx, 8));
+                    a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(vip, 1));
+                    a.add(vip, 5);
+                    jump_using_table(a, paths, labels.size());
+
+                    a.bind(trap);
+                    a.ud2();
+
+                    // memcpy/memmove(dst, src, n): copies backwards when dst lies inside
+                    // the source, 16 bytes at a time then the tail
+                    //
+                    {
+                        auto forward = a.createLabel(), forward_tail = a.createLabel();
+                        auto backward = a.createLabel(), backward_tail = a.createLabel();
+
+                        a.bind(at(v0_intrinsic::memcpy));
+                        a.bind(at(v0_intrinsic::memmove));
+                        a.mov(zasm::x86::rcx, zasm::x86::r10);
+                        a.mov(zasm::x86::r9, zasm::x86::r10);
+                        a.sub(zasm::x86::r9, zasm::x86::r11);
+                        a.cmp(zasm::x86::r9, zasm::x86::rdx);
+                        a.jb(backward);
+
+                        a.bind(forward);
+                        a.cmp(zasm::x86::rdx, 16);
+                        a.jb(forward_tail);
+                        a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r11));
+                        a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                        a.add(zasm::x86::r11, 16);
+                        a.add(zasm::x86::r10, 16);
+                        a.sub(zasm::x86::rdx, 16);
+                        a.jmp(forward);
+
+                        a.bind(forward_tail);
+                        a.test(zasm::x86::rdx, zasm::x86::rdx);
+                        a.jz(done);
+                        a.mov(zasm::x86::r9b, zasm::x86::byte_ptr(zasm::x86::r11));
+                        a.mov(zasm::x86::byte_ptr(zasm::x86::r10), zasm::x86::r9b);
+                        a.add(zasm::x86::r11, 1);
+                        a.add(zasm::x86::r10, 1);
+                        a.sub(zasm::x86::rdx, 1);
+                        a.jmp(forward_tail);
+
+                        a.bind(backward);
+                        a.add(zasm::x86::r10, zasm::x86::rdx);
+                        a.add(zasm::x86::r11, zasm::x86::rdx);
+                        auto backward_loop = a.createLabel();
+                        a.bind(backward_loop);
+                        a.cmp(zasm::x86::rdx, 16);
+                        a.jb(backward_tail);
+                        a.sub(zasm::x86::r11, 16);
+                        a.sub(zasm::x86::r10, 16);
+                        a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r11));
+                        a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                        a.sub(zasm::x86::rdx, 16);
+                        a.jmp(backward_loop);
+
+                        a.bind(backward_tail);
+                        a.test(zasm::x86::rdx, zasm::x86::rdx);
+                        a.jz(done);
+                        a.sub(zasm::x86::r11, 1);
+                        a.sub(zasm::x86::r10, 1);
+                        a.mov(zasm::x86::r9b, zasm::x86::byte_ptr(zasm::x86::r11));
+                        a.mov(zasm::x86::byte_ptr(zasm::x86::r10), zasm::x86::r9b);
+                        a.sub(zasm::x86::rdx, 1);
+                        a.jmp(backward_tail);
+                    }
+
+                    // memset(dst, c, n): c broadcast across xmm0
+                    //
+                    {
+                        auto fill = a.createLabel(), fill_tail = a.createLabel();
+
+                        a.bind(at(v0_intrinsic::memset));
+                        a.mov(zasm::x86::rcx, zasm::x86::r10);
+                        a.movd(zasm::x86::xmm0, zasm::x86::r11d);
+                        a.pxor(zasm::x86::xmm1, zasm::x86::xmm1);
+                        a.pshufb(zasm::x86::xmm0, zasm::x86::xmm1);
+
+                        a.bind(fill);
+                        a.cmp(zasm::x86::rdx, 16);
+                        a.jb(fill_tail);
+                        a.movdqu(zasm::x86::xmmword_ptr(zasm::x86::r10), zasm::x86::xmm0);
+                        a.add(zasm::x86::r10, 16);
+                        a.sub(zasm::x86::rdx, 16);
+                        a.jmp(fill);
+
+                        a.bind(fill_tail);
+                        a.test(zasm::x86::rdx, zasm::x86::rdx);
+                        a.jz(done);
+                        a.mov(zasm::x86::byte_ptr(zasm::x86::r10), zasm::x86::r11b);
+                        a.add(zasm::x86::r10, 1);
+                        a.sub(zasm::x86::rdx, 1);
+                        a.jmp(fill_tail);
+                    }
+
+                    // memcmp(a, b, n): 16 byte blocks until one differs, the bytes
+                    // are compared one at a time from the first mismatch
+                    //
+                    {
+                        auto block = a.createLabel(), mismatch = a.createLabel();
+                        auto bytes = a.createLabel(), differ = a.createLabel();
+
+                        a.bind(at(v0_intrinsic::memcmp));
+                        a.bind(block);
+                        a.cmp(zasm::x86::rdx, 16);
+                        a.jb(bytes);
+                        a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r10));
+                        a.movdqu(zasm::x86::xmm1, zasm::x86::xmmword_ptr(zasm::x86::r11));
+                        a.pcmpeqb(zasm::x86::xmm0, zasm::x86::xmm1);
+                        a.pmovmskb(zasm::x86::r9d, zasm::x86::xmm0);
+                        a.cmp(zasm::x86::r9d, 0xffff);
+                        a.jne(mismatch);
+                        a.add(zasm::x86::r10, 16);
+                        a.add(zasm::x86::r11, 16);
+                        a.sub(zasm::x86::rdx, 16);
+                        a.jmp(block);
+
+                        a.bind(mismatch);
+                        a.not_(zasm::x86::r9d);
+                        a.bsf(zasm::x86::r9d, zasm::x86::r9d);
+                        a.add(zasm::x86::r10, zasm::x86::r9);
+                        a.add(zasm::x86::r11, zasm::x86::r9);
+
+                        a.bind(bytes);
+                        a.xor_(zasm::x86::ecx, zasm::x86::ecx);
+                        a.test(zasm::x86::rdx, zasm::x86::rdx);
+                        a.jz(done);
+                        a.movzx(zasm::x86::ecx, zasm::x86::byte_ptr(zasm::x86::r10));
+                        a.movzx(zasm::x86::r9d, zasm::x86::byte_ptr(zasm::x86::r11));
+                        a.cmp(zasm::x86::ecx, zasm::x86::r9d);
+                        a.jne(differ);
+                        a.add(zasm::x86::r10, 1);
+                        a.add(zasm::x86::r11, 1);
+                        a.sub(zasm::x86::rdx, 1);
+                        a.jmp(bytes);
+
+                        a.bind(differ);
+                        a.sub(zasm::x86::ecx, zasm::x86::r9d);
+                        a.jmp(done);
+                    }
+
+                    // strlen(s): aligned 16 byte loads never cross into the next page,
+                    // the bytes before `s` in the first one are shifted out
+                    //
+                    {
+                        auto scan = a.createLabel();
+
+                        a.bind(at(v0_intrinsic::strlen));
+                        a.mov(zasm::x86::r11, zasm::x86::r10);
+                        a.and_(zasm::x86::r11, -16);
+                        a.mov(zasm::x86::ecx, zasm::x86::r10d);
+                        a.and_(zasm::x86::ecx, 15);
+                        a.pxor(zasm::x86::xmm1, zasm::x86::xmm1);
+                        a.movdqa(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r11));
+                        a.pcmpeqb(zasm::x86::xmm0, zasm::x86::xmm1);
+                        a.pmovmskb(zasm::x86::r9d, zasm::x86::xmm0);
+                        a.shr(zasm::x86::r9d, zasm::x86::cl);
+                        a.test(zasm::x86::r9d, zasm::x86::r9d);
+                        a.jz(scan);
+                        a.bsf(zasm::x86::ecx, zasm::x86::r9d);
+                        a.jmp(done);
+
+                        a.bind(scan);
+                        a.add(zasm::x86::r11, 16);
+                        a.movdqa(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r11));
+                        a.pcmpeqb(zasm::x86::xmm0, zasm::x86::xmm1);
+                        a.pmovmskb(zasm::x86::r9d, zasm::x86::xmm0);
+                        a.test(zasm::x86::r9d, zasm::x86::r9d);
+                        a.jz(scan);
+                        a.bsf(zasm::x86::r9d, zasm::x86::r9d);
+                        a.lea(zasm::x86::rcx, zasm::x86::qword_ptr(zasm::x86::r11, zasm::x86::r9, 1));
+                        a.sub(zasm::x86::rcx, zasm::x86::r10);
+                    }
+
+                    // the result goes to the guest's rax, the other caller saved
+                    // registers are left as they were
+                    //
+                    a.bind(done);
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vcontext"]));
+                    a.mov(zasm::x86::qword_ptr(zasm::x86::r9), zasm::x86::rcx);
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(zasm::x86::rip, global_labels["vrep_scratch"]));
+                    a.movdqu(zasm::x86::xmm0, zasm::x86::xmmword_ptr(zasm::x86::r9));
+                    a.movdqu(zasm::x86::xmm1, zasm::x86::xmmword_ptr(zasm::x86::r9, 16));
+                    vm_next_instruction(a);
+                }
+            },
+            {
+                uint8_t(v0_op::jit_resume), [&](zasm::x86::Assembler& a) {
+                    a.bind(global_labels["vjit_resume"]);
+
+                    // only ever found in the jit cache, after an instruction whose handler
+                    // the translation called; its native code continues right behind
+                    //
+                    pin_jit_registers(a);
+                    a.lea(zasm::x86::r9, zasm::x86::qword_ptr(vip, 1));
+                    a.jmp(zasm::x86::r9);
+                }
             }
         };
     };